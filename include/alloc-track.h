@@ -0,0 +1,35 @@
+#ifndef K_ALLOC_TRACK_H
+#define K_ALLOC_TRACK_H
+
+#include <stdint.h>
+
+// Allocation counting works by linking the test binary with
+//   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+// so only calls made from code that was linked that way are seen, memory
+// libc allocates internally (strdup for instance) is not. Counting is per
+// thread so threads a test starts are not included.
+typedef struct {
+    uint64_t allocs; // Calls that handed out a block
+    uint64_t frees;
+    uint64_t bytes;  // Bytes requested
+    int64_t  live;   // Bytes handed out minus bytes given back
+    int64_t  peak;   // Highest live was since the start
+} allocStats;
+
+// Non-zero if the binary was linked with the wraps above.
+int  alloc_track_available();
+
+// Starts counting on this thread, for the setup through to the teardown.
+void alloc_track_begin();
+// Marks the start of the test body, the peak is measured from here.
+void alloc_track_body_begin();
+// Returns what the test body did.
+void alloc_track_body_end(allocStats* body);
+// Stops counting and returns everything since alloc_track_begin().
+void alloc_track_end(allocStats* total);
+// Stops counting on this thread while the framework allocates on a test's
+// behalf, returns what to hand alloc_track_resume() after.
+int  alloc_track_pause();
+void alloc_track_resume(int paused);
+
+#endif
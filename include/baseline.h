@@ -0,0 +1,47 @@
+#ifndef K_BASELINE_H
+#define K_BASELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "filter.h"
+#include "reporter.h"
+
+// Runs since a case last failed, for cases never seen failing.
+#define BASELINE_NEVER_FAILED UINT32_MAX
+
+// The timings of one case from an earlier run.
+typedef struct {
+    size_t     name;       // Offset of the name in the names buffer
+    uint64_t   time_ns;
+    uint32_t   since_fail; // 0 if it failed in that run
+    benchStats bench;      // samples is zero if it was not a benchmark
+} baselineEntry;
+
+typedef struct {
+    baselineEntry* entries;
+    size_t         count;
+    size_t         cap;
+    char*          names;
+    size_t         names_len;
+    size_t         names_cap;
+    nameIndex      index;
+} baselineFile;
+
+// Reads a file written by --save-baseline. The case_end lines written by
+// the jsonl reporter are read as well, anything else is skipped. Returns
+// non-zero if the file could not be read.
+int  baseline_load(baselineFile* b, const char* path);
+const baselineEntry* baseline_find(const baselineFile* b, const char* name);
+void baseline_free(baselineFile* b);
+
+// A reporter that saves the timings of this run to save_path and compares
+// the benchmarks against the ones in compare_path, either may be NULL. A
+// median that moved by more than threshold, as a fraction, and by more
+// than the noise in both runs is a regression. Returns 1 if compare_path
+// could not be read or 2 if save_path could not be opened.
+int    baseline_reporter_init(reporter* r, const char* save_path, const char* compare_path, double threshold);
+size_t baseline_regressions(const reporter* r);
+
+#endif
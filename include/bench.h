@@ -0,0 +1,51 @@
+#ifndef K_BENCH_H
+#define K_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ktest.h"
+
+#define BENCH_MAX_SAMPLES 100
+
+// What was done to steady the timings, as bits of benchStats.applied.
+#define BENCH_PINNED   0x01U
+#define BENCH_PRIORITY 0x02U
+#define BENCH_WARMUP   0x04U
+#define BENCH_COLD     0x08U
+#define BENCH_MAD      0x10U
+
+typedef struct {
+    uint64_t target_ns; // Total time to spend measuring each benchmark
+    size_t   samples;   // Number of timed batches, at most BENCH_MAX_SAMPLES
+    int      cpu;       // Pinned to while measuring, -1 to leave it be
+    int      priority;  // Raise the priority while measuring
+    size_t   warmup;    // Untimed batches ran before the samples
+    int      cold;      // Thrash the caches before every iteration
+    double   mad_limit; // Drop samples this many MADs from the median, 0 keeps all
+} benchConfig;
+
+// All the times are in nano seconds per call of the benchmark body.
+typedef struct {
+    uint64_t iters;     // Iterations in each sample
+    size_t   samples;   // Zero if the benchmark never finished
+    double   min;
+    double   median;
+    double   mean;
+    double   stddev;
+    double   p99;
+    double   cycles;    // Median in counter cycles rather than time
+    unsigned applied;   // BENCH_ bits for what was actually done
+    int      cpu;       // Pinned to, if BENCH_PINNED
+    int      priority;  // Levels raised by, if BENCH_PRIORITY
+    size_t   outliers;  // Samples dropped, not counted in samples
+} benchStats;
+
+// Calls fn until the number of iterations per sample fills the target
+// time, then takes the samples. Stops early if the body fails. Cold runs
+// take every sample from a single call after thrashing the caches, the
+// target time doesn't apply to them.
+void bench_run(const benchConfig* cfg, kTestStatus* stat, tcFn fn, void* fix, benchStats* stats);
+void bench_compute_stats(double* samples, size_t count, benchStats* stats);
+void bench_format_ns(double amt, char buffer[14]);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef K_FILTER_H
+#define K_FILTER_H
+
+#include <stddef.h>
+
+typedef struct {
+    const char* name;
+    size_t      id;
+} nameSlot;
+
+// Open addressed hash table from a test case name to it's index.
+typedef struct {
+    nameSlot* slots;
+    size_t    mask;
+} nameIndex;
+
+// Sizes the index for count names. Returns non-zero if it could not be
+// allocated.
+int  name_index_init(nameIndex* idx, size_t count);
+// Only the first id added for a name is kept.
+void name_index_add(nameIndex* idx, const char* name, size_t id);
+int  name_index_find(const nameIndex* idx, const char* name, size_t* id);
+void name_index_free(nameIndex* idx);
+
+// Matches str against a pattern where '*' matches any run of characters
+// and '?' any single one.
+int glob_match(const char* pat, const char* str);
+int glob_has_wild(const char* pat);
+
+// The patterns are kept one after the other in buf, each ending with a
+// NULL byte. Patterns starting with '-' exclude the cases they match.
+typedef struct {
+    char*  buf;
+    size_t len;
+    size_t cap;
+    size_t count;
+} filterList;
+
+// Adds each of the ':' separated patterns in pats.
+int  filter_add(filterList* f, const char* pats);
+// Adds the patterns in a file, one per line. Blank lines and lines
+// starting with '#' are ignored.
+int  filter_add_file(filterList* f, const char* path);
+// Returns the pattern after cur or the first one if cur is NULL, and NULL
+// after the last.
+const char* filter_next(const filterList* f, const char* cur);
+void filter_free(filterList* f);
+
+#endif
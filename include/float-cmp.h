@@ -0,0 +1,30 @@
+#ifndef K_FLOAT_CMP_H
+#define K_FLOAT_CMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// How far apart two arrays are by each measure, and where each was worst.
+typedef struct {
+    double   max_abs;
+    double   max_rel;
+    uint64_t max_ulp;
+    size_t   at_abs;
+    size_t   at_rel;
+    size_t   at_ulp;
+} floatStats;
+
+// Counts the elements where |a - e| > abs_tol + rel_tol * |e|. Equal values
+// are always near, infinities included, and a NaN never is.
+size_t float_far_f32(const float* a, const float* e, size_t n, double abs_tol, double rel_tol);
+size_t float_far_f64(const double* a, const double* e, size_t n, double abs_tol, double rel_tol);
+
+// Counts the elements more than ulps representable values apart.
+size_t float_ulp_far_f32(const float* a, const float* e, size_t n, uint64_t ulps);
+size_t float_ulp_far_f64(const double* a, const double* e, size_t n, uint64_t ulps);
+
+// Only needed once something failed, so these are plain loops.
+void float_stats_f32(const float* a, const float* e, size_t n, floatStats* st);
+void float_stats_f64(const double* a, const double* e, size_t n, floatStats* st);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef K_GOLDEN_H
+#define K_GOLDEN_H
+
+// While updating, a golden file that doesn't match is rewritten with what
+// the test produced instead of failing the check.
+void golden_configure(int update);
+
+#endif
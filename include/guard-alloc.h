@@ -0,0 +1,20 @@
+#ifndef K_GUARD_ALLOC_H
+#define K_GUARD_ALLOC_H
+
+#include <stddef.h>
+
+// Every block ends right where a page that can't be read or written
+// starts, so running off the end of it faults on the spot rather than
+// corrupting whatever came after, even by a single byte. A block is only
+// aligned as far as it's size is, which is all a single fixture needs.
+// Blocks of up to GUARD_POOL_PAGES pages are kept for reuse once freed,
+// so only the first of each size costs any system calls. Safe to use from
+// any thread.
+#define GUARD_POOL_PAGES 16
+
+void* guard_alloc(size_t size);
+void  guard_free(void* ptr, size_t size);
+// Unmaps everything kept for reuse.
+void  guard_pool_clear();
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef K_HIST_H
+#define K_HIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Log-linear buckets in the style of HdrHistogram. Values under
+// 2 * HIST_HALF are counted exactly, above that every power of two is
+// split into HIST_HALF buckets so a value is never off by more than
+// 1 / HIST_HALF of itself. The size is fixed however many are added.
+#define HIST_SUB_BITS 7
+#define HIST_HALF     (1u << (HIST_SUB_BITS - 1))
+#define HIST_BUCKETS  ((66 - HIST_SUB_BITS) * HIST_HALF)
+
+typedef struct {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} latencyHist;
+
+void hist_init(latencyHist* h);
+void hist_add(latencyHist* h, uint64_t value);
+// pct is from 0 to 100, the result is kept within the exact min and max.
+uint64_t hist_percentile(const latencyHist* h, double pct);
+
+#endif
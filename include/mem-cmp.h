@@ -0,0 +1,20 @@
+#ifndef K_MEM_CMP_H
+#define K_MEM_CMP_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Index of the first byte that differs between a and b, or len if they
+// are the same.
+size_t mem_mismatch(const void* a, const void* b, size_t len);
+
+// Index of the first character that differs between the strings, or the
+// length of both if they are equal.
+size_t str_mismatch(const char* a, const char* b);
+
+// Prints a few rows of hex and ASCII from both buffers around the byte at
+// index at, marking the bytes that differ. Only the first len bytes of
+// either are read.
+void mem_print_diff(FILE* out, const void* actual, const void* expected, size_t len, size_t at);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef K_ORDER_H
+#define K_ORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ktest.h"
+#include "baseline.h"
+#include "reporter.h"
+
+// Cases that failed within this many runs are ran before the rest.
+#define ORDER_RECENT_RUNS 3
+
+// How the cases that have not failed recently are ordered.
+typedef enum {
+    ORDER_REGISTERED,
+    ORDER_SHORTEST,
+    ORDER_LONGEST,
+    ORDER_SHUFFLE
+} orderPolicy;
+
+// Reorders the cases in place. history may be NULL, the durations for the
+// shortest and longest policies come from it and any case missing from it
+// counts as the average of the ones that are there. Ties keep the order
+// they were in. Returns non-zero if it could not allocate, which leaves
+// the cases as they were.
+int order_cases(kTestCase** cases, size_t count, const baselineFile* history, orderPolicy policy, uint64_t seed);
+
+// A reporter writing the history read back by order_cases to path. Cases
+// in old that did not run this time are carried over as they were so a
+// partial run does not forget them. old needs to outlive the reporter.
+// Returns non-zero if the file could not be opened.
+int history_reporter_init(reporter* r, const char* path, const baselineFile* old);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef K_PERF_COUNTERS_H
+#define K_PERF_COUNTERS_H
+
+#include <stdint.h>
+
+enum perfCounter {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+// A group of hardware counters for the calling thread that are started and
+// stopped together. Counters the CPU or kernel don't support are left out
+// of the group.
+typedef struct {
+    int fds[PERF_COUNTER_COUNT];
+    int order[PERF_COUNTER_COUNT]; // The counter for each value in a group read
+    int count;
+} perfGroup;
+
+typedef struct {
+    int      valid;
+    int      have[PERF_COUNTER_COUNT];
+    uint64_t counts[PERF_COUNTER_COUNT];
+} perfCounts;
+
+// Returns 0 on success otherwise the errno of the first counter that failed
+// to open.
+int  perf_group_open(perfGroup* group);
+void perf_group_start(perfGroup* group);
+void perf_group_stop(perfGroup* group, perfCounts* counts);
+void perf_group_close(perfGroup* group);
+// Returns -1 if it could not be read.
+int  perf_get_paranoid();
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef K_POOL_H
+#define K_POOL_H
+
+#include <stddef.h>
+
+// Called once for every item, worker is the index of the worker thread
+// running it, from 0 to workers - 1.
+typedef void (*poolFn)(void* ctx, size_t worker, size_t item);
+
+// Runs fn over the items 0 to items - 1 on a work stealing pool of
+// threads. The calling thread works as worker 0, so it only returns once
+// every item has been ran.
+void pool_run(size_t workers, size_t items, poolFn fn, void* ctx);
+
+#endif
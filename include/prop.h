@@ -0,0 +1,12 @@
+#ifndef K_PROP_H
+#define K_PROP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every property is ran iters times unless it asks for a count of it's
+// own. Each property mixes it's name into the seed so they all get
+// different inputs while one seed still replays the whole run.
+void prop_configure(uint64_t seed, size_t iters);
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef K_REPORTER_H
+#define K_REPORTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "console.h"
+#include "timer.h"
+#include "bench.h"
+#include "perf-counters.h"
+#include "alloc-track.h"
+#include "sys-info.h"
+
+#define REPORT_MSG_LEN 256
+
+// How long each run of a repeated case took, runs is zero unless it was.
+typedef struct {
+    uint64_t runs;
+    uint64_t failed;
+    uint64_t min_ns;
+    uint64_t median_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+} repeatStats;
+
+// Everything measured while running a single test case. A repeated case
+// keeps what the first failing run measured, or the last run if none
+// failed, except the time which is from the start of the first run to the
+// end of the last.
+typedef struct {
+    int         result;
+    unsigned    asserts;
+    unsigned    expects;
+    timerData   time;
+    benchStats  bench;
+    perfCounts  perf;
+    allocStats  allocs;
+    allocStats  leaks;
+    repeatStats repeat;
+} caseResult;
+
+// A failed check, or why the case failed if it was not a check. The file
+// is NULL in that case.
+typedef struct {
+    const char* file;
+    unsigned    line;
+    char        msg[REPORT_MSG_LEN];
+} caseFailure;
+
+typedef struct {
+    const char*        name;
+    const char*        description;
+    const caseResult*  res;
+    const caseFailure* failures;
+    size_t             failure_count;
+} caseReport;
+
+typedef struct {
+    const char* name;
+    int         passed;
+    int         failed;
+    int         skipped;
+    uint64_t    ns;
+} runSummary;
+
+typedef struct reporter_s reporter;
+
+// The console output for a case goes to out, which is the worker's buffer
+// when running in parallel. Reporters with a file of their own ignore it.
+// res is NULL in case_start. Any callback may be NULL.
+typedef struct {
+    void (*suite_start)(reporter* r, outputInfo* out, const char* suite, size_t count);
+    void (*case_start)(reporter* r, outputInfo* out, const caseReport* c);
+    void (*assert_fail)(reporter* r, outputInfo* out, const caseReport* c, const caseFailure* f);
+    void (*case_end)(reporter* r, outputInfo* out, const caseReport* c);
+    void (*case_skip)(reporter* r, outputInfo* out, const caseReport* c);
+    void (*summary)(reporter* r, outputInfo* out, const runSummary* s);
+    void (*close)(reporter* r);
+} reporterOps;
+
+struct reporter_s {
+    const reporterOps* ops;
+    FILE*              output;
+    int                close_output;
+    size_t             index;
+    const void*        data;
+    void*              state;
+};
+
+// Sets up one of the reporters writing to a file by name, "jsonl",
+// "junit" or "tap". It writes to stdout if path is NULL. Returns 1 if the
+// name is unknown or 2 if the file could not be opened.
+int  reporter_init(reporter* r, const char* name, const char* path);
+void reporter_close(reporter* r);
+
+// Writes str as a quoted JSON string, or null if it is NULL.
+void report_write_json_str(FILE* out, const char* str);
+// Writes the stats as a "bench" member, starting with the comma.
+void report_write_json_bench(FILE* out, const benchStats* bench);
+// Writes the machine as an object, anything that wasn't found as null.
+void report_write_json_machine(FILE* out, const machineInfo* m);
+
+// Records a failure against the case running on this thread, which passes
+// it on to the reporters or keeps it for the parent process when forked.
+#if defined(__GNUC__)
+__attribute__((format(printf, 3, 4)))
+#endif
+void ktest_report_failure(const char* file, unsigned line, const char* fmt, ...);
+// While muted the failures of the case on this thread are dropped, for
+// running it over and over when only the last run counts.
+void ktest_report_mute(int mute);
+// The case running on this thread, for threads it starts to adopt so
+// their failures are recorded against it too.
+void* ktest_report_context();
+void  ktest_report_adopt(void* ctx);
+
+#endif
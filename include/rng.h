@@ -0,0 +1,43 @@
+#ifndef K_RNG_H
+#define K_RNG_H
+
+#include <stdint.h>
+
+// xoshiro256** seeded through splitmix64. Not for anything but making test
+// inputs, it only needs to be quick and the same for the same seed on
+// every machine.
+typedef struct {
+    uint64_t s[4];
+} rngState;
+
+static inline uint64_t rng_splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline void rng_seed(rngState* rng, uint64_t seed) {
+    for(int i = 0; i < 4; i++) {
+        rng->s[i] = rng_splitmix64(&seed);
+    }
+}
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(rngState* rng) {
+    uint64_t* s      = rng->s;
+    uint64_t  result = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t  t      = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3]  = rng_rotl(s[3], 45);
+    return result;
+}
+
+#endif
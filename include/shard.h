@@ -0,0 +1,13 @@
+#ifndef K_SHARD_H
+#define K_SHARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Splits count items over shards so the total cost in each comes out about
+// the same, placing the most costly item left onto the least loaded shard
+// each time. Ties go to the lower index so the same input always gives the
+// same split. Returns non-zero if it could not allocate.
+int shard_partition(const uint64_t* cost, size_t count, size_t shards, size_t* shard_of);
+
+#endif
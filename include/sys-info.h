@@ -40,8 +40,46 @@
     #define CURRENT_OS OS_UNKNOWN
 #endif
 
+// What the machine a run is on looks like, for making sense of timings
+// later. Sizes are in bytes and anything that couldn't be found is zero,
+// empty or -1 for turbo.
+typedef struct {
+    char   cpu_model[64];
+    size_t cores;
+    size_t threads;
+    size_t numa_nodes;
+    size_t l1d_size;
+    size_t l2_size;
+    size_t l3_size;
+    size_t line_size;
+    size_t max_mhz;
+    char   governor[32];
+    int    turbo;
+    double load_avg;
+} machineInfo;
+
+// Where a thread was allowed to run before it was pinned.
+typedef struct {
+    uint64_t mask[16];
+} threadAffinity;
+
 unsigned get_arch();
 unsigned get_os();
 size_t   get_memory_page_size();
+size_t   get_cpu_count();
+// Pins the calling thread to the index-th CPU it may run on, wrapping
+// around when there are fewer. Returns the CPU or -1 if it wasn't pinned.
+int      set_thread_cpu(size_t index);
+// Pins the calling thread to exactly that CPU, keeping where it could run
+// before in saved. Returns non-zero if it wasn't pinned.
+int      pin_thread(int cpu, threadAffinity* saved);
+void     unpin_thread(const threadAffinity* saved);
+// Raises the priority of the calling thread as far as it is allowed to.
+// Returns by how many levels, zero if not at all in which case there is
+// nothing to restore.
+int      raise_thread_priority(int* saved);
+void     restore_thread_priority(int saved);
+// Looked up on the first call only, call it before starting any threads.
+const machineInfo* get_machine_info();
 
 #endif
\ No newline at end of file
@@ -2,25 +2,11 @@
 #define K_TIMER_H
 
 #include "sys-info.h"
+#include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <math.h>
 
-static void timer_format_ns(double amt, char buffer[14]) {
-    char units[5][3] = {
-        { "ns" },
-        { "us" },
-        { "ms" },
-        { "s"  },
-        { "ks" }
-    };
-    int i = 0;
-    while(fabs(amt) > 1000 && i < 5) {
-        i++;
-        amt /= 1000;
-    }
-    snprintf(buffer, 14, i == 0 ? "%.0f%s" : "%.2f%s", amt, units[i]);
-}
-
 #if CURRENT_OS == OS_LINUX || CURRENT_OS == OS_UNIX_LIKE
 #include <time.h>
 
@@ -37,21 +23,16 @@ static FORCE_INLINE void timer_stop(timerData* data) {
     clock_gettime(CLOCK_MONOTONIC, &(data->t1));
 }
 
-static void timer_get_str(const timerData* data, char buffer[14]) {
-    uint32_t n0     = data->t0.tv_nsec;
-    uint32_t n1     = data->t1.tv_nsec;
-    uint32_t borrow = n0 > n1;
-    uint32_t nsec   = n1 - n0;
-    int32_t  secs   = data->t1.tv_sec - data->t0.tv_sec - borrow;
-    if(secs != 0) {
-        // Just handle seconds in it's own case to make things simpler
-        // to avoid having to juggle 2 different variables for the next
-        // part
-        int tens = rintf(((float)nsec / 1000000000.0f) * 10.0f);
-        snprintf(buffer, 14, "%d.%ds", secs, tens);
-        return;
-    }
-    timer_format_ns(nsec, buffer);
+static inline uint64_t timer_get_ns(const timerData* data) {
+    int64_t secs = data->t1.tv_sec  - data->t0.tv_sec;
+    int64_t nsec = data->t1.tv_nsec - data->t0.tv_nsec;
+    return secs * 1000000000 + nsec;
+}
+
+static FORCE_INLINE uint64_t timer_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
 }
 
 #elif CURRENT_OS == OS_WINDOWS
@@ -69,17 +50,140 @@ static FORCE_INLINE void timer_stop(timerData* data) {
     QueryPerformanceCounter(&(data->t1));
 }
 
-static void timer_get_str(const timerData* data, char buffer[14]) {
+static inline uint64_t timer_get_ns(const timerData* data) {
     LARGE_INTEGER freq = { 0 };
     if(!QueryPerformanceFrequency(&freq) || freq.QuadPart == 0) {
-        snprintf(buffer, 14, "Failed!");
+        return 0;
+    }
+    uint64_t time = data->t1.QuadPart - data->t0.QuadPart;
+    uint64_t hz   = freq.QuadPart;
+    // Split it up so the multiply can't overflow
+    return (time / hz) * 1000000000 + ((time % hz) * 1000000000) / hz;
+}
+
+static FORCE_INLINE uint64_t timer_now_ns() {
+    LARGE_INTEGER freq = { 0 };
+    LARGE_INTEGER now  = { 0 };
+    if(!QueryPerformanceFrequency(&freq) || freq.QuadPart == 0) {
+        return 0;
+    }
+    QueryPerformanceCounter(&now);
+    uint64_t time = now.QuadPart;
+    uint64_t hz   = freq.QuadPart;
+    return (time / hz) * 1000000000 + ((time % hz) * 1000000000) / hz;
+}
+
+#endif
+
+// Formats with integers only so there is no rounding through a float on
+// the way.
+static inline void timer_format_ns_u64(uint64_t ns, char buffer[14]) {
+    const char units[5][3] = {
+        { "ns" },
+        { "us" },
+        { "ms" },
+        { "s"  },
+        { "ks" }
+    };
+    if(ns < 1000) {
+        snprintf(buffer, 14, "%"PRIu64"%s", ns, units[0]);
+        return;
+    }
+    uint64_t div = 1000;
+    int      i   = 1;
+    while(ns / div >= 1000 && i < 4) {
+        div *= 1000;
+        i++;
     }
-    int64_t time  = data->t1.QuadPart - data->t0.QuadPart;
-    double  scale = (double)1000000000.0f / ((double)freq.QuadPart);
-    double  amt   = time * scale; // Time in nano seconds
-    timer_format_ns(amt, buffer);
+    unsigned hundredths = (unsigned)(((ns % div) * 100) / div);
+    snprintf(buffer, 14, "%"PRIu64".%02u%s", ns / div, hundredths, units[i]);
 }
 
+static inline void timer_get_str(const timerData* data, char buffer[14]) {
+    timer_format_ns_u64(timer_get_ns(data), buffer);
+}
+
+// Cycle counter timer for measuring things that take less than the
+// ~20ns a clock_gettime() call costs. Reading the counter is serialized
+// so the timed code can't be reordered around it.
+typedef struct {
+    uint64_t c0;
+    uint64_t c1;
+} cycleData;
+
+#if defined(__GNUC__) && CURRENT_ARCH == X86_64
+    #define TIMER_CYCLE_SOURCE "rdtsc"
+
+    static FORCE_INLINE uint64_t timer_cycles_begin() {
+        uint32_t lo;
+        uint32_t hi;
+        // The first lfence waits for earlier instructions to finish, the
+        // second keeps later ones from starting before the read.
+        __asm__ __volatile__("lfence\n\trdtsc\n\tlfence" : "=a"(lo), "=d"(hi) :: "memory");
+        return ((uint64_t)hi << 32) | lo;
+    }
+
+    static FORCE_INLINE uint64_t timer_cycles_end() {
+        uint32_t lo;
+        uint32_t hi;
+        uint32_t aux;
+        // rdtscp waits for everything before it, lfence for it to finish.
+        __asm__ __volatile__("rdtscp\n\tlfence" : "=a"(lo), "=d"(hi), "=c"(aux) :: "memory");
+        return ((uint64_t)hi << 32) | lo;
+    }
+#elif defined(__GNUC__) && CURRENT_ARCH == ARM_64
+    #define TIMER_CYCLE_SOURCE "cntvct_el0"
+
+    // The generic timer ticks at a fixed rate rather than with the core
+    // clock, so "cycles" here are ticks of that timer.
+    static FORCE_INLINE uint64_t timer_cycles_begin() {
+        uint64_t val;
+        __asm__ __volatile__("isb\n\tmrs %0, cntvct_el0" : "=r"(val) :: "memory");
+        return val;
+    }
+
+    static FORCE_INLINE uint64_t timer_cycles_end() {
+        uint64_t val;
+        __asm__ __volatile__("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r"(val) :: "memory");
+        return val;
+    }
+#else
+    #define TIMER_CYCLE_SOURCE "monotonic"
+
+    static FORCE_INLINE uint64_t timer_cycles_begin() {
+        return timer_now_ns();
+    }
+
+    static FORCE_INLINE uint64_t timer_cycles_end() {
+        return timer_now_ns();
+    }
 #endif
 
+// Measures the counter frequency against the monotonic clock and the
+// cost of an empty start/stop pair. Call once before starting threads.
+void     timer_calibrate();
+double   timer_ns_per_cycle();
+uint64_t timer_cycle_overhead();
+
+static FORCE_INLINE void cycle_timer_start(cycleData* data) {
+    data->c0 = timer_cycles_begin();
+}
+
+static FORCE_INLINE void cycle_timer_stop(cycleData* data) {
+    data->c1 = timer_cycles_end();
+}
+
+// Elapsed cycles with the cost of reading the counter taken out.
+static inline uint64_t cycle_timer_get_cycles(const cycleData* data) {
+    uint64_t raw      = data->c1 - data->c0;
+    uint64_t overhead = timer_cycle_overhead();
+    return raw > overhead ? raw - overhead : 0;
+}
+
+static inline uint64_t cycle_timer_get_ns(const cycleData* data) {
+    uint64_t  cycles = cycle_timer_get_cycles(data);
+    long long ns     = llround(cycles * timer_ns_per_cycle());
+    return ns;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,641 @@
+#ifndef KTEST_C_H
+#define KTEST_C_H
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+struct test_list_s;
+typedef struct test_list_s kTestList;
+
+struct ktest_status_s {
+    FILE*    output;
+    int      result;
+    unsigned asserts;
+    unsigned expects;
+};
+typedef struct ktest_status_s kTestStatus;
+
+typedef void (*tcFn) (kTestStatus*, void*);
+typedef void (*fixFn)(kTestStatus*, void*);
+typedef void (*tearFn)(kTestStatus*, void*);
+
+struct suite_fix_s;
+
+// Describes a single test case. The name and description are used in place
+// so they need to outlive the run, which string literals always do.
+struct ktest_case_s {
+    struct ktest_case_s* next;
+    tcFn                 test_func;
+    fixFn                setup;
+    tearFn               tear;
+    const char*          name;
+    const char*          description;
+    size_t               fix_sz;
+    struct suite_fix_s*  suite;
+    int                  status;
+    int                  skip;
+    int                  bench;
+    unsigned             timeout_ms;
+    const void*          params;
+    size_t               param_count;
+    size_t               param_size;
+};
+typedef struct ktest_case_s kTestCase;
+
+int ktest_main(int argc, char** argv, const char* name, int (*test_setup)(kTestList*, char**, int*));
+int ktest_add_test_case(size_t* handle, kTestList* list, tcFn test_func, const char* name, const char* description);
+int ktest_add_bench_case(size_t* handle, kTestList* list, tcFn bench_func, const char* name, const char* description);
+int ktest_add_param_case(size_t* handle, kTestList* list, tcFn test_func, const char* name, const char* description,
+                         const void* params, size_t param_count, size_t param_size);
+int ktest_set_fixture(size_t handle, kTestList* list, fixFn setup, tearFn teardown, size_t fixture_size);
+void ktest_register_case(kTestCase* tc);
+int ktest_set_suite_fixture(size_t handle, kTestList* list, fixFn setup, tearFn teardown, size_t fixture_size, const char* name);
+int ktest_set_timeout(size_t handle, kTestList* list, unsigned timeout_ms);
+
+int ktest_str_eq(FILE* out, const char* file, unsigned line, const char* str1, const char* str2);
+int ktest_str_ne(FILE* out, const char* file, unsigned line, const char* str1, const char* str2);
+int ktest_mem_eq(FILE* out, const char* file, unsigned line, const void* actual, const void* expected, size_t len);
+// The file at path is mapped rather than read so even a huge one costs no
+// copy. Relative paths are from the directory the tests are ran in.
+int ktest_golden(FILE* out, const char* file, unsigned line, const void* buf, size_t len, const char* path);
+
+// How far apart floating point values may be, tol is absolute, relative to
+// the expected value or in representable values between them.
+#define KTEST_NEAR_ABS 0
+#define KTEST_NEAR_REL 1
+#define KTEST_NEAR_ULP 2
+
+int ktest_near_f32(FILE* out, const char* file, unsigned line, const float* actual, const float* expected, size_t count, int mode, double tol);
+int ktest_near_f64(FILE* out, const char* file, unsigned line, const double* actual, const double* expected, size_t count, int mode, double tol);
+
+void ktest_allocs_mark();
+int  ktest_allocs_le(FILE* out, const char* file, unsigned line, uint64_t max);
+
+// The inputs of a property test come from these. Each draws from a range
+// that shrinks towards the value closest to zero, the buffers live until
+// the next input is made so nothing is allocated while generating.
+struct ktest_prop_s;
+typedef struct ktest_prop_s kTestProp;
+typedef void (*propFn)(kTestStatus*, kTestProp*);
+
+void        ktest_prop_run(kTestStatus* status, const char* name, size_t iters, propFn prop);
+int64_t     ktest_gen_i64(kTestProp* prop, int64_t lo, int64_t hi);
+uint64_t    ktest_gen_u64(kTestProp* prop, uint64_t lo, uint64_t hi);
+double      ktest_gen_f64(kTestProp* prop, double lo, double hi);
+void*       ktest_gen_bytes(kTestProp* prop, size_t max_len, size_t* len);
+const char* ktest_gen_str(kTestProp* prop, size_t max_len);
+
+// The body of a threaded case, called on every thread with it's index.
+typedef void (*threadFn)(kTestStatus*, void*, size_t);
+
+void ktest_run_threaded(kTestStatus* status, void* fix, size_t threads, threadFn fn);
+
+#define _KTEST_GENERAL_ERR  0x0000
+#define _KTEST_MEMORY_ERR   0xF000
+
+// General Statuses
+#define KTEST_SUCCESS        _KTEST_GENERAL_ERR
+#define KTEST_BAD_HANDLE     (0x0001 | _KTEST_GENERAL_ERR)
+#define KTEST_FIX_CONFLICT   (0x0002 | _KTEST_GENERAL_ERR)
+#define KTEST_UNKNOWN_ERR    (0x0FFF | _KTEST_GENERAL_ERR)
+// Memory Statuses
+#define KTEST_MALLOC_FAIL    (0x0001 | _KTEST_MEMORY_ERR)
+#define KTEST_REALLOC_FAIL   (0x0002 | _KTEST_MEMORY_ERR)
+#define KTEST_UNKOWN_MEM     (0x0FFF | _KTEST_MEMORY_ERR)
+
+#define KTEST_CASE(NAME)          void ktest_case_##NAME(kTestStatus* status__, void* fix)
+#define KTEST_CASE_FIX(NAME, FIX) void ktest_case_##NAME(kTestStatus* status__, struct FIX* fix)
+// A suite fixture is shared with every other case using it so it is only
+// handed out read-only.
+#define KTEST_CASE_SUITE_FIX(NAME, FIX) void ktest_case_##NAME(kTestStatus* status__, const struct FIX* fix)
+
+// The body of a benchmark is called over and over while it is timed, any
+// fixture set on it is set up and torn down once outside of the timing.
+#define KTEST_BENCH(NAME)          void ktest_bench_##NAME(kTestStatus* status__, void* fix)
+#define KTEST_BENCH_FIX(NAME, FIX) void ktest_bench_##NAME(kTestStatus* status__, struct FIX* fix)
+
+// Ran once for every element of an array, each time as a case of it's own
+// named NAME/index. The element is handed over in place of a fixture so a
+// param case can't have one.
+#define KTEST_CASE_PARAM(NAME, TYPE) void ktest_case_##NAME(kTestStatus* status__, const TYPE* param)
+
+#define KTEST_FIX(NAME)           void ktest_fixture_##NAME(kTestStatus* status__, struct NAME* fix)
+#define KTEST_FIX_TEARDOWN(NAME)  void ktest_teardown_##NAME(kTestStatus* status__, struct NAME* fix)
+
+#define KTEST_SETUP(NAME) \
+    int ktest_setup_##NAME(kTestList* ktest_list__, char** ktest_file__, int* ktest_line__); \
+    int main(int argc, char **argv) { \
+        return ktest_main(argc, argv, #NAME, ktest_setup_##NAME); \
+    } \
+    int ktest_setup_##NAME(kTestList* ktest_list__, char** ktest_file__, int* ktest_line__)
+
+#define KTEST_ADD_CASE(NAME, HANDLE_OUT) KTEST_ADD_CASE_EX(NAME, HANDLE_OUT, "")
+
+#define KTEST_ADD_CASE_EX(NAME, HANDLE_OUT, DESCRIPTION) \
+    do { \
+        int ktest_err = ktest_add_test_case((HANDLE_OUT), ktest_list__, (tcFn)ktest_case_##NAME, #NAME, DESCRIPTION); \
+        if(ktest_err != KTEST_SUCCESS) { \
+            *ktest_file__ = __FILE__; \
+            *ktest_line__ = __LINE__; \
+            return ktest_err; \
+        } \
+    } while (0)
+
+// PARAMS has to be an array rather than a pointer, and has to outlive the
+// run as the cases point into it instead of copying the elements.
+#define KTEST_ADD_CASE_PARAM(NAME, PARAMS, HANDLE_OUT) \
+    do { \
+        int ktest_err = ktest_add_param_case((HANDLE_OUT), ktest_list__, (tcFn)ktest_case_##NAME, #NAME, "", \
+                                             (PARAMS), sizeof(PARAMS) / sizeof((PARAMS)[0]), sizeof((PARAMS)[0])); \
+        if(ktest_err != KTEST_SUCCESS) { \
+            *ktest_file__ = __FILE__; \
+            *ktest_line__ = __LINE__; \
+            return ktest_err; \
+        } \
+    } while (0)
+
+#define KTEST_ADD_BENCH(NAME, HANDLE_OUT) KTEST_ADD_BENCH_EX(NAME, HANDLE_OUT, "")
+
+#define KTEST_ADD_BENCH_EX(NAME, HANDLE_OUT, DESCRIPTION) \
+    do { \
+        int ktest_err = ktest_add_bench_case((HANDLE_OUT), ktest_list__, (tcFn)ktest_bench_##NAME, #NAME, DESCRIPTION); \
+        if(ktest_err != KTEST_SUCCESS) { \
+            *ktest_file__ = __FILE__; \
+            *ktest_line__ = __LINE__; \
+            return ktest_err; \
+        } \
+    } while (0)
+
+#define KTEST_SET_FIXTURE(NAME, HANDLE) \
+    do { \
+        int ktest_err = ktest_set_fixture((HANDLE), ktest_list__, (fixFn)ktest_fixture_##NAME, (tearFn)ktest_teardown_##NAME, sizeof(struct NAME)); \
+        if(ktest_err != KTEST_SUCCESS) { \
+            *ktest_file__ = __FILE__; \
+            *ktest_line__ = __LINE__; \
+            return ktest_err; \
+        } \
+    } while (0)
+
+// Sets up the fixture once before the first case using it runs, and tears
+// it down after the last. A case can have either a suite fixture or it's
+// own fixture, not both. If the setup fails the teardown is not ran and
+// every case using it fails without running. The setup and teardown run
+// in the harness itself even with --fork, so a crash or hang in them is
+// not isolated the way one in a case is.
+#define KTEST_SET_SUITE_FIXTURE(NAME, HANDLE) \
+    do { \
+        int ktest_err = ktest_set_suite_fixture((HANDLE), ktest_list__, (fixFn)ktest_fixture_##NAME, (tearFn)ktest_teardown_##NAME, sizeof(struct NAME), #NAME); \
+        if(ktest_err != KTEST_SUCCESS) { \
+            *ktest_file__ = __FILE__; \
+            *ktest_line__ = __LINE__; \
+            return ktest_err; \
+        } \
+    } while (0)
+
+// Fails the case if it runs for longer than TIMEOUT_MS, overriding the
+// --timeout given on the command line, five minutes unless given. Zero
+// goes back to that default.
+#define KTEST_SET_TIMEOUT(HANDLE, TIMEOUT_MS) \
+    do { \
+        int ktest_err = ktest_set_timeout((HANDLE), ktest_list__, (TIMEOUT_MS)); \
+        if(ktest_err != KTEST_SUCCESS) { \
+            *ktest_file__ = __FILE__; \
+            *ktest_line__ = __LINE__; \
+            return ktest_err; \
+        } \
+    } while (0)
+
+#if defined(_MSC_VER)
+    #pragma section(".CRT$XCU", read)
+    #define KTEST_CONSTRUCTOR(FN) \
+        static void FN(void); \
+        __declspec(allocate(".CRT$XCU")) void (*FN##_ptr__)(void) = FN; \
+        static void FN(void)
+#else
+    #define KTEST_CONSTRUCTOR(FN) \
+        static void FN(void) __attribute__((constructor)); \
+        static void FN(void)
+#endif
+
+// Cases defined with these register themselves before main runs, so they
+// need no KTEST_ADD_CASE. The descriptor is static and the name is used in
+// place so registering does not allocate or copy anything.
+#define KTEST_AUTO_REGISTER__(PREFIX, NAME, DESCRIPTION, SETUP, TEAR, FIX_SZ, BENCH, TIMEOUT) \
+    static kTestCase ktest_desc_##NAME = { \
+        .test_func   = (tcFn)PREFIX##NAME, \
+        .setup       = (fixFn)(SETUP), \
+        .tear        = (tearFn)(TEAR), \
+        .name        = #NAME, \
+        .description = DESCRIPTION, \
+        .fix_sz      = (FIX_SZ), \
+        .bench       = (BENCH), \
+        .timeout_ms  = (TIMEOUT) \
+    }; \
+    KTEST_CONSTRUCTOR(ktest_register_##NAME) { \
+        ktest_register_case(&ktest_desc_##NAME); \
+    }
+
+#define KTEST_AUTO_CASE(NAME) KTEST_AUTO_CASE_EX(NAME, "")
+
+#define KTEST_AUTO_CASE_EX(NAME, DESCRIPTION) \
+    KTEST_CASE(NAME); \
+    KTEST_AUTO_REGISTER__(ktest_case_, NAME, DESCRIPTION, NULL, NULL, 0, 0, 0) \
+    KTEST_CASE(NAME)
+
+#define KTEST_AUTO_CASE_TIMEOUT(NAME, TIMEOUT_MS) \
+    KTEST_CASE(NAME); \
+    KTEST_AUTO_REGISTER__(ktest_case_, NAME, "", NULL, NULL, 0, 0, TIMEOUT_MS) \
+    KTEST_CASE(NAME)
+
+// The fixture's setup and teardown need to be defined before the case.
+#define KTEST_AUTO_CASE_FIX(NAME, FIX) \
+    KTEST_CASE_FIX(NAME, FIX); \
+    KTEST_AUTO_REGISTER__(ktest_case_, NAME, "", ktest_fixture_##FIX, ktest_teardown_##FIX, sizeof(struct FIX), 0, 0) \
+    KTEST_CASE_FIX(NAME, FIX)
+
+// Only the one descriptor is registered, it becomes a case per element
+// when the cases are collected. The unused function checks PARAMS holds
+// TYPE.
+#define KTEST_AUTO_CASE_PARAM(NAME, TYPE, PARAMS) \
+    KTEST_CASE_PARAM(NAME, TYPE); \
+    static inline const TYPE* ktest_params_##NAME(void) { \
+        return (PARAMS); \
+    } \
+    static kTestCase ktest_desc_##NAME = { \
+        .test_func   = (tcFn)ktest_case_##NAME, \
+        .name        = #NAME, \
+        .description = "", \
+        .params      = (PARAMS), \
+        .param_count = sizeof(PARAMS) / sizeof((PARAMS)[0]), \
+        .param_size  = sizeof((PARAMS)[0]) \
+    }; \
+    KTEST_CONSTRUCTOR(ktest_register_##NAME) { \
+        ktest_register_case(&ktest_desc_##NAME); \
+    } \
+    KTEST_CASE_PARAM(NAME, TYPE)
+
+#define KTEST_AUTO_BENCH(NAME) \
+    KTEST_BENCH(NAME); \
+    KTEST_AUTO_REGISTER__(ktest_bench_, NAME, "", NULL, NULL, 0, 1, 0) \
+    KTEST_BENCH(NAME)
+
+// A property is ran over many generated inputs. Once one fails it is
+// shrunk to the smallest input that still fails, which is then ran again
+// to print it's failures along with the seed to replay it with. ITERS of
+// zero uses --prop-iters.
+#define KTEST_PROPERTY_ITERS(NAME, ITERS) \
+    static void ktest_prop_##NAME(kTestStatus* status__, kTestProp* prop__); \
+    KTEST_CASE(NAME) { \
+        (void)fix; \
+        ktest_prop_run(status__, #NAME, (ITERS), ktest_prop_##NAME); \
+    } \
+    static void ktest_prop_##NAME(kTestStatus* status__, kTestProp* prop__)
+
+#define KTEST_PROPERTY(NAME) KTEST_PROPERTY_ITERS(NAME, 0)
+
+#define KTEST_AUTO_PROPERTY_ITERS(NAME, ITERS) \
+    KTEST_CASE(NAME); \
+    KTEST_AUTO_REGISTER__(ktest_case_, NAME, "", NULL, NULL, 0, 0, 0) \
+    KTEST_PROPERTY_ITERS(NAME, ITERS)
+
+#define KTEST_AUTO_PROPERTY(NAME) KTEST_AUTO_PROPERTY_ITERS(NAME, 0)
+
+// The body runs on NTHREADS threads at once, each pinned to a CPU of it's
+// own where there are enough and all released together once every one of
+// them is ready. Every thread checks into a status of it's own which are
+// added up once they are done, thread_index tells them apart. NTHREADS of
+// zero starts one for every CPU. Allocations on the threads aren't
+// tracked.
+#define KTEST_CASE_THREADED(NAME, NTHREADS) \
+    static void ktest_thread_##NAME(kTestStatus* status__, void* fix, size_t thread_index); \
+    KTEST_CASE(NAME) { \
+        ktest_run_threaded(status__, fix, (NTHREADS), ktest_thread_##NAME); \
+    } \
+    static void ktest_thread_##NAME(kTestStatus* status__, void* fix, size_t thread_index)
+
+#define KTEST_AUTO_CASE_THREADED(NAME, NTHREADS) \
+    KTEST_CASE(NAME); \
+    KTEST_AUTO_REGISTER__(ktest_case_, NAME, "", NULL, NULL, 0, 0, 0) \
+    KTEST_CASE_THREADED(NAME, NTHREADS)
+
+#define K_GEN_INT(LO, HI)          ktest_gen_i64(prop__, (LO), (HI))
+#define K_GEN_UINT(LO, HI)         ktest_gen_u64(prop__, (LO), (HI))
+#define K_GEN_DOUBLE(LO, HI)       ktest_gen_f64(prop__, (LO), (HI))
+#define K_GEN_BOOL()               (ktest_gen_u64(prop__, 0, 1) != 0)
+#define K_GEN_BYTES(MAX, LEN_OUT)  ktest_gen_bytes(prop__, (MAX), (LEN_OUT))
+#define K_GEN_STR(MAX)             ktest_gen_str(prop__, (MAX))
+
+// A main for a suite made only of self registering cases.
+#define KTEST_AUTO_MAIN(NAME) \
+    int main(int argc, char **argv) { \
+        return ktest_main(argc, argv, #NAME, NULL); \
+    }
+
+#define KTEST_PRINTF(...) \
+    do { \
+        if(status__->output) { \
+            fprintf(status__->output, __VA_ARGS__); \
+        } \
+    } while(0)
+
+#if defined(__GNUC__)
+    #define KTEST_LIKELY(x) __builtin_expect(!!(x), 1)
+    #define KTEST_COLD      __attribute__((cold, noinline))
+    // Evaluates x once into a temporary of it's own type, the comma makes
+    // arrays decay and drops qualifiers.
+    #define KTEST_AUTO(NAME, x) __typeof__((void)0, (x)) NAME = (x)
+    #define KTEST_AUTO_VAL(NAME, x) (NAME)
+    // Constants are compared as they are so the compare warns no more than
+    // a bare one would, the likes of an unsigned against 3 or a pointer
+    // against 0. Evaluating a constant again has no side effects.
+    #define KTEST_AUTO_CMP(NAME, x) __builtin_choose_expr(__builtin_constant_p(x), (x), (NAME))
+    // Only pointers give a ptrdiff_t back, __extension__ lets a void
+    // pointer through -pedantic-errors too.
+    #define KTEST_SELF_DIFF(x) (__extension__ ((x) - (x)))
+#else
+    #define KTEST_LIKELY(x) (x)
+    #define KTEST_COLD
+    // No typeof so the operands are evaluated again when printing a failure.
+    #define KTEST_AUTO(NAME, x) (void)0
+    #define KTEST_AUTO_VAL(NAME, x) (x)
+    #define KTEST_AUTO_CMP(NAME, x) (x)
+    #define KTEST_SELF_DIFF(x) ((x) - (x))
+#endif
+
+#define KTEST_VAL_INT     0
+#define KTEST_VAL_UINT    1
+#define KTEST_VAL_FLOAT   2
+#define KTEST_VAL_LDOUBLE 3
+#define KTEST_VAL_PTR     4
+
+// A value to print when a comparison fails, so the printing can happen out
+// of line.
+typedef struct {
+    int type;
+    union {
+        int64_t              i;
+        uint64_t             u;
+        double               f;
+        long double          ld;
+        const volatile void* p;
+    } val;
+} kTestValue;
+
+static inline void ktest_val_i64(kTestValue* v, int64_t x) {
+    v->type  = KTEST_VAL_INT;
+    v->val.i = x;
+}
+
+static inline void ktest_val_u64(kTestValue* v, uint64_t x) {
+    v->type  = KTEST_VAL_UINT;
+    v->val.u = x;
+}
+
+static inline void ktest_val_f64(kTestValue* v, double x) {
+    v->type  = KTEST_VAL_FLOAT;
+    v->val.f = x;
+}
+
+static inline void ktest_val_ld(kTestValue* v, long double x) {
+    v->type   = KTEST_VAL_LDOUBLE;
+    v->val.ld = x;
+}
+
+static inline void ktest_val_ptr(kTestValue* v, const volatile void* x) {
+    v->type  = KTEST_VAL_PTR;
+    v->val.p = x;
+}
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define KTEST_VAL(v, x)                                  \
+    _Generic((x),                                        \
+        _Bool             : ktest_val_u64,               \
+        char              : ktest_val_i64,               \
+        signed char       : ktest_val_i64,               \
+        unsigned char     : ktest_val_u64,               \
+        short             : ktest_val_i64,               \
+        unsigned short    : ktest_val_u64,               \
+        int               : ktest_val_i64,               \
+        unsigned int      : ktest_val_u64,               \
+        long              : ktest_val_i64,               \
+        unsigned long     : ktest_val_u64,               \
+        long long         : ktest_val_i64,               \
+        unsigned long long: ktest_val_u64,               \
+        float             : ktest_val_f64,               \
+        double            : ktest_val_f64,               \
+        long double       : ktest_val_ld,                \
+        default           : _Generic(KTEST_SELF_DIFF(x), \
+            ptrdiff_t: ktest_val_ptr,                    \
+            default  : ktest_val_i64                     \
+        )                                                \
+    )(v, x)
+#else
+#define KTEST_VAL(v, x) ktest_val_u64(v, (uint64_t)(x))
+#endif
+
+// The failure paths are kept out of line so the passing path of a check
+// is just the compare.
+KTEST_COLD void ktest_fail_cmp(kTestStatus* status, const char* file, unsigned line, const char* kind, const char* cmp, const kTestValue* x, const kTestValue* y);
+KTEST_COLD void ktest_fail_bool(kTestStatus* status, const char* file, unsigned line, const char* kind, int expected, const kTestValue* x);
+
+#define KTEST_BOOL_CHECK(x, val, kind, counter, on_fail)      \
+    do {                                                      \
+        KTEST_AUTO(ktest_x__, x);                             \
+        status__->counter++;                                  \
+        if(!KTEST_LIKELY(KTEST_AUTO_CMP(ktest_x__, x) == val)) { \
+            kTestValue ktest_vx__;                            \
+            KTEST_VAL(&ktest_vx__, KTEST_AUTO_VAL(ktest_x__, x)); \
+            ktest_fail_bool(status__, __FILE__, __LINE__, kind, val, &ktest_vx__); \
+            on_fail;                                          \
+        }                                                     \
+    } while(0)
+
+#define K_ASSERT_EQ_TRUE(x)  KTEST_BOOL_CHECK(x, 1, "Asserted", asserts, return)
+#define K_ASSERT_EQ_FALSE(x) KTEST_BOOL_CHECK(x, 0, "Asserted", asserts, return)
+#define K_EXPECT_EQ_TRUE(x)  KTEST_BOOL_CHECK(x, 1, "Expected", expects, (void)0)
+#define K_EXPECT_EQ_FALSE(x) KTEST_BOOL_CHECK(x, 0, "Expected", expects, (void)0)
+
+#define KTEST_CMP_CHECK(x, y, cmp, kind, counter, on_fail)    \
+    do {                                                      \
+        KTEST_AUTO(ktest_x__, x);                             \
+        KTEST_AUTO(ktest_y__, y);                             \
+        status__->counter++;                                  \
+        if(!KTEST_LIKELY(KTEST_AUTO_CMP(ktest_x__, x) cmp KTEST_AUTO_CMP(ktest_y__, y))) { \
+            kTestValue ktest_vx__;                            \
+            kTestValue ktest_vy__;                            \
+            KTEST_VAL(&ktest_vx__, KTEST_AUTO_VAL(ktest_x__, x)); \
+            KTEST_VAL(&ktest_vy__, KTEST_AUTO_VAL(ktest_y__, y)); \
+            ktest_fail_cmp(status__, __FILE__, __LINE__, kind, #cmp, &ktest_vx__, &ktest_vy__); \
+            on_fail;                                          \
+        }                                                     \
+    } while(0)
+
+#define K_ASSERT(x, y, cmp) KTEST_CMP_CHECK(x, y, cmp, "Asserted", asserts, return)
+#define K_EXPECT(x, y, cmp) KTEST_CMP_CHECK(x, y, cmp, "Expected", expects, (void)0)
+
+#define K_ASSERT_EQ(x, y) K_ASSERT(x, y, ==)
+#define K_ASSERT_LT(x, y) K_ASSERT(x, y, <)
+#define K_ASSERT_LE(x, y) K_ASSERT(x, y, <=)
+#define K_ASSERT_GT(x, y) K_ASSERT(x, y, >)
+#define K_ASSERT_GE(x, y) K_ASSERT(x, y, >=)
+#define K_ASSERT_NE(x, y) K_ASSERT(x, y, !=)
+
+#define K_EXPECT_EQ(x, y) K_EXPECT(x, y, ==)
+#define K_EXPECT_LT(x, y) K_EXPECT(x, y, <)
+#define K_EXPECT_LE(x, y) K_EXPECT(x, y, <=)
+#define K_EXPECT_GT(x, y) K_EXPECT(x, y, >)
+#define K_EXPECT_GE(x, y) K_EXPECT(x, y, >=)
+#define K_EXPECT_NE(x, y) K_EXPECT(x, y, !=)
+
+#define K_ASSERT_STR_EQ(x, y)     \
+    do {                          \
+        status__->asserts++;      \
+        if( ktest_str_eq(status__->output, __FILE__, __LINE__, (x), (y)) ) { \
+            status__->result = 1; \
+            return;               \
+        }                         \
+    } while(0)
+
+#define K_ASSERT_STR_NE(x, y)     \
+    do {                          \
+        status__->asserts++;      \
+        if( ktest_str_ne(status__->output, __FILE__, __LINE__, (x), (y)) ) { \
+            status__->result = 1; \
+            return;               \
+        }                         \
+    } while(0)
+
+#define K_EXPECT_STR_EQ(x, y)     \
+    do {                          \
+        status__->expects++;      \
+        if( ktest_str_eq(status__->output, __FILE__, __LINE__, (x), (y)) ) { \
+            status__->result = 1; \
+        }                         \
+    } while(0)
+
+#define K_EXPECT_STR_NE(x, y)     \
+    do {                          \
+        status__->expects++;      \
+        if( ktest_str_ne(status__->output, __FILE__, __LINE__, (x), (y)) ) { \
+            status__->result = 1; \
+        }                         \
+    } while(0)
+
+// Compares len bytes of both buffers. A failure shows the bytes around the
+// first difference as hex rather than the whole buffer.
+#define K_ASSERT_MEM_EQ(x, y, len) \
+    do {                          \
+        status__->asserts++;      \
+        if( ktest_mem_eq(status__->output, __FILE__, __LINE__, (x), (y), (len)) ) { \
+            status__->result = 1; \
+            return;               \
+        }                         \
+    } while(0)
+
+#define K_EXPECT_MEM_EQ(x, y, len) \
+    do {                          \
+        status__->expects++;      \
+        if( ktest_mem_eq(status__->output, __FILE__, __LINE__, (x), (y), (len)) ) { \
+            status__->result = 1; \
+        }                         \
+    } while(0)
+
+#define K_ASSERT_MATCHES_GOLDEN(buf, len, path) \
+    do {                          \
+        status__->asserts++;      \
+        if( ktest_golden(status__->output, __FILE__, __LINE__, (buf), (len), (path)) ) { \
+            status__->result = 1; \
+            return;               \
+        }                         \
+    } while(0)
+
+#define K_EXPECT_MATCHES_GOLDEN(buf, len, path) \
+    do {                          \
+        status__->expects++;      \
+        if( ktest_golden(status__->output, __FILE__, __LINE__, (buf), (len), (path)) ) { \
+            status__->result = 1; \
+        }                         \
+    } while(0)
+
+static inline int ktest_near1_f32(FILE* out, const char* file, unsigned line, float actual, float expected, int mode, double tol) {
+    return ktest_near_f32(out, file, line, &actual, &expected, 1, mode, tol);
+}
+
+static inline int ktest_near1_f64(FILE* out, const char* file, unsigned line, double actual, double expected, int mode, double tol) {
+    return ktest_near_f64(out, file, line, &actual, &expected, 1, mode, tol);
+}
+
+// Floats are compared as floats so ULPs are counted in their precision,
+// anything else as a double.
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define KTEST_NEAR_FN(x)                  \
+    _Generic(&(x)[0],                     \
+        float*       : ktest_near_f32,    \
+        const float* : ktest_near_f32,    \
+        default      : ktest_near_f64     \
+    )
+#define KTEST_NEAR1_FN(x, y)              \
+    _Generic((x) + (y),                   \
+        float   : ktest_near1_f32,        \
+        default : ktest_near1_f64         \
+    )
+#else
+#define KTEST_NEAR_FN(x)     ktest_near_f64
+#define KTEST_NEAR1_FN(x, y) ktest_near1_f64
+#endif
+
+#define KTEST_NEAR_CHECK(call, counter, on_fail) \
+    do {                          \
+        status__->counter++;      \
+        if( call ) {              \
+            status__->result = 1; \
+            on_fail;              \
+        }                         \
+    } while(0)
+
+#define KTEST_NEAR1(x, y, mode, tol) \
+    KTEST_NEAR1_FN(x, y)(status__->output, __FILE__, __LINE__, (x), (y), mode, (tol))
+#define KTEST_NEAR_N(x, y, n, mode, tol) \
+    KTEST_NEAR_FN(x)(status__->output, __FILE__, __LINE__, (x), (y), (n), mode, (tol))
+
+#define K_ASSERT_NEAR(x, y, tol)     KTEST_NEAR_CHECK(KTEST_NEAR1(x, y, KTEST_NEAR_ABS, tol), asserts, return)
+#define K_ASSERT_REL_NEAR(x, y, tol) KTEST_NEAR_CHECK(KTEST_NEAR1(x, y, KTEST_NEAR_REL, tol), asserts, return)
+#define K_ASSERT_ULP_EQ(x, y, ulps)  KTEST_NEAR_CHECK(KTEST_NEAR1(x, y, KTEST_NEAR_ULP, ulps), asserts, return)
+#define K_EXPECT_NEAR(x, y, tol)     KTEST_NEAR_CHECK(KTEST_NEAR1(x, y, KTEST_NEAR_ABS, tol), expects, (void)0)
+#define K_EXPECT_REL_NEAR(x, y, tol) KTEST_NEAR_CHECK(KTEST_NEAR1(x, y, KTEST_NEAR_REL, tol), expects, (void)0)
+#define K_EXPECT_ULP_EQ(x, y, ulps)  KTEST_NEAR_CHECK(KTEST_NEAR1(x, y, KTEST_NEAR_ULP, ulps), expects, (void)0)
+
+// The whole of both arrays is checked in one go, a failure reports how
+// many elements were off and the worst of them.
+#define K_ASSERT_ARRAY_NEAR(x, y, n, tol)     KTEST_NEAR_CHECK(KTEST_NEAR_N(x, y, n, KTEST_NEAR_ABS, tol), asserts, return)
+#define K_ASSERT_ARRAY_REL_NEAR(x, y, n, tol) KTEST_NEAR_CHECK(KTEST_NEAR_N(x, y, n, KTEST_NEAR_REL, tol), asserts, return)
+#define K_ASSERT_ARRAY_ULP_EQ(x, y, n, ulps)  KTEST_NEAR_CHECK(KTEST_NEAR_N(x, y, n, KTEST_NEAR_ULP, ulps), asserts, return)
+#define K_EXPECT_ARRAY_NEAR(x, y, n, tol)     KTEST_NEAR_CHECK(KTEST_NEAR_N(x, y, n, KTEST_NEAR_ABS, tol), expects, (void)0)
+#define K_EXPECT_ARRAY_REL_NEAR(x, y, n, tol) KTEST_NEAR_CHECK(KTEST_NEAR_N(x, y, n, KTEST_NEAR_REL, tol), expects, (void)0)
+#define K_EXPECT_ARRAY_ULP_EQ(x, y, n, ulps)  KTEST_NEAR_CHECK(KTEST_NEAR_N(x, y, n, KTEST_NEAR_ULP, ulps), expects, (void)0)
+
+// Allocation checks need the test binary linked with
+//   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+// They count the allocations made on the test's thread since the test body
+// started, or since the last K_ALLOCS_MARK().
+#define K_ALLOCS_MARK() ktest_allocs_mark()
+
+#define K_ASSERT_ALLOCS_LE(n)     \
+    do {                          \
+        status__->asserts++;      \
+        if( ktest_allocs_le(status__->output, __FILE__, __LINE__, (n)) ) { \
+            status__->result = 1; \
+            return;               \
+        }                         \
+    } while(0)
+
+#define K_EXPECT_ALLOCS_LE(n)     \
+    do {                          \
+        status__->expects++;      \
+        if( ktest_allocs_le(status__->output, __FILE__, __LINE__, (n)) ) { \
+            status__->result = 1; \
+        }                         \
+    } while(0)
+
+#endif
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include <stddef.h>
+#include <stdio.h>
+
+#include "ktest.h"
+#include "alloc-track.h"
+#include "reporter.h"
+#include "console.h"
+#include "sys-info.h"
+
+#if CURRENT_OS == OS_WINDOWS
+    #include <malloc.h>
+    #define usable_size(ptr) _msize(ptr)
+#elif defined(__GLIBC__)
+    #include <malloc.h>
+    #define usable_size(ptr) malloc_usable_size(ptr)
+#else
+    // Live bytes can't be tracked, just the number of blocks
+    #define usable_size(ptr) ((void)(ptr), (size_t)0)
+#endif
+
+// These only resolve when the binary is linked with --wrap, otherwise they
+// stay NULL and nothing below is ever called.
+extern void* __real_malloc(size_t size) __attribute__((weak));
+extern void* __real_calloc(size_t count, size_t size) __attribute__((weak));
+extern void* __real_realloc(void* ptr, size_t size) __attribute__((weak));
+extern void  __real_free(void* ptr) __attribute__((weak));
+
+typedef struct {
+    int        active;
+    allocStats cur;
+    allocStats body; // Counts at the start of the test body
+    allocStats mark; // Counts at the last K_ALLOCS_MARK()
+} allocState;
+
+static _Thread_local allocState state;
+
+static void alloc_record(void* ptr, size_t size) {
+    state.cur.allocs++;
+    state.cur.bytes += size;
+    state.cur.live  += usable_size(ptr);
+    if(state.cur.live > state.cur.peak) {
+        state.cur.peak = state.cur.live;
+    }
+}
+
+static void alloc_record_free(size_t size) {
+    state.cur.frees++;
+    state.cur.live -= size;
+}
+
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    if(ptr != NULL && state.active) {
+        alloc_record(ptr, size);
+    }
+    return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    void* ptr = __real_calloc(count, size);
+    if(ptr != NULL && state.active) {
+        alloc_record(ptr, count * size);
+    }
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    size_t old = ptr != NULL && state.active ? usable_size(ptr) : 0;
+    void*  ret = __real_realloc(ptr, size);
+    if(!state.active) {
+        return ret;
+    }
+    if(ret != NULL) {
+        if(ptr != NULL) {
+            alloc_record_free(old);
+        }
+        alloc_record(ret, size);
+    } else if(ptr != NULL && size == 0) {
+        // Some libcs free the block and return NULL here
+        alloc_record_free(old);
+    }
+    return ret;
+}
+
+void __wrap_free(void* ptr) {
+    if(ptr != NULL && state.active) {
+        alloc_record_free(usable_size(ptr));
+    }
+    __real_free(ptr);
+}
+
+int alloc_track_available() {
+    return __real_malloc != NULL;
+}
+
+void alloc_track_begin() {
+    allocStats zero = { 0 };
+    state.cur    = zero;
+    state.body   = zero;
+    state.mark   = zero;
+    state.active = 1;
+}
+
+void alloc_track_body_begin() {
+    state.cur.peak = state.cur.live;
+    state.body     = state.cur;
+    state.mark     = state.cur;
+}
+
+void alloc_track_body_end(allocStats* body) {
+    body->allocs = state.cur.allocs - state.body.allocs;
+    body->frees  = state.cur.frees  - state.body.frees;
+    body->bytes  = state.cur.bytes  - state.body.bytes;
+    body->live   = state.cur.live   - state.body.live;
+    body->peak   = state.cur.peak   - state.body.live;
+}
+
+void alloc_track_end(allocStats* total) {
+    state.active = 0;
+    *total       = state.cur;
+}
+
+int alloc_track_pause() {
+    int was = state.active;
+    state.active = 0;
+    return was;
+}
+
+void alloc_track_resume(int paused) {
+    state.active = paused;
+}
+
+void ktest_allocs_mark() {
+    state.mark = state.cur;
+}
+
+int ktest_allocs_le(FILE* out, const char* file, unsigned line, uint64_t max) {
+    uint64_t count = state.cur.allocs - state.mark.allocs;
+    if(alloc_track_available() && count <= max) {
+        return 0;
+    }
+    if(!alloc_track_available()) {
+        ktest_report_failure(file, line, "allocation tracking is not linked in");
+    } else {
+        ktest_report_failure(file, line, "Expected : allocations <= %"PRIu64", Actual : %"PRIu64" allocations", max, count);
+    }
+    if(out == NULL) {
+        return 1;
+    }
+    fprintf(out, "Test Failure : %s:%u\n", file, line);
+    if(!alloc_track_available()) {
+        fprintf(out, "    Expected : allocation tracking\n");
+        fprintf(out, "      Actual : %snot linked in%s, link with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free\n\n", get_fg_color_if_tty(L_RED, out), get_reset_if_tty(out));
+        return 1;
+    }
+    fprintf(out, "    Expected : allocations <= %"PRIu64"\n", max);
+    fprintf(out, "      Actual : %s%"PRIu64"%s allocations\n\n", get_fg_color_if_tty(L_RED, out), count, get_reset_if_tty(out));
+    return 1;
+}
@@ -0,0 +1,352 @@
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "baseline.h"
+
+typedef struct {
+    baselineFile old;
+    int          comparing;
+    double       threshold;
+    size_t       regressions;
+} baselineState;
+
+// Finds where the value of "key" starts in a flat JSON object. Nested
+// objects are searched too, the keys written here are never repeated.
+static const char* json_find(const char* line, const char* key) {
+    size_t      len = strlen(key);
+    const char* cur = line;
+    while((cur = strchr(cur, '"')) != NULL) {
+        cur++;
+        if(strncmp(cur, key, len) == 0 && cur[len] == '"') {
+            cur += len + 1;
+            while(*cur == ' ') {
+                cur++;
+            }
+            if(*cur == ':') {
+                cur++;
+                while(*cur == ' ') {
+                    cur++;
+                }
+                return cur;
+            }
+            continue;
+        }
+        // Skip over the rest of the string.
+        while(*cur && *cur != '"') {
+            if(*cur == '\\' && cur[1]) {
+                cur++;
+            }
+            cur++;
+        }
+        if(*cur) {
+            cur++;
+        }
+    }
+    return NULL;
+}
+
+// Unescapes the JSON string at cur into out, which needs to hold at least
+// strlen(cur) bytes. Returns non-zero if it is not a string.
+static int json_read_str(const char* cur, char* out) {
+    if(*cur != '"') {
+        return 1;
+    }
+    for(cur++; *cur != '"'; cur++) {
+        if(*cur == '\0') {
+            return 1;
+        }
+        if(*cur != '\\') {
+            *out++ = *cur;
+            continue;
+        }
+        cur++;
+        switch(*cur) {
+            case 'n': *out++ = '\n'; break;
+            case 't': *out++ = '\t'; break;
+            case 'r': *out++ = '\r'; break;
+            case 'u': {
+                char          hex[5] = { 0 };
+                unsigned long val    = 0;
+                if(strlen(cur + 1) < 4) {
+                    return 1;
+                }
+                memcpy(hex, cur + 1, 4);
+                val = strtoul(hex, NULL, 16);
+                // Only ever written for control characters.
+                *out++ = val < 0x100 ? (char)val : '?';
+                cur += 4;
+                break;
+            }
+            case '\0':
+                return 1;
+            default:
+                *out++ = *cur;
+                break;
+        }
+    }
+    *out = '\0';
+    return 0;
+}
+
+static double json_double(const char* line, const char* key) {
+    const char* cur = json_find(line, key);
+    return cur == NULL ? 0 : strtod(cur, NULL);
+}
+
+static uint64_t json_u64(const char* line, const char* key) {
+    const char* cur = json_find(line, key);
+    return cur == NULL ? 0 : strtoull(cur, NULL, 10);
+}
+
+static int baseline_add_line(baselineFile* b, const char* line) {
+    const char* name = json_find(line, "case");
+    if(name == NULL || json_find(line, "time_ns") == NULL) {
+        return 0;
+    }
+    size_t len = strlen(name) + 1;
+    if(b->names_len + len > b->names_cap) {
+        size_t new_cap = b->names_cap ? b->names_cap : 4096;
+        while(new_cap < b->names_len + len) {
+            new_cap *= 2;
+        }
+        char* new = realloc(b->names, new_cap);
+        if(new == NULL) {
+            return 1;
+        }
+        b->names     = new;
+        b->names_cap = new_cap;
+    }
+    if(b->count >= b->cap) {
+        size_t         new_cap = b->cap ? b->cap * 2 : 64;
+        baselineEntry* new     = realloc(b->entries, sizeof(baselineEntry) * new_cap);
+        if(new == NULL) {
+            return 1;
+        }
+        b->entries = new;
+        b->cap     = new_cap;
+    }
+    if(b->names == NULL || json_read_str(name, b->names + b->names_len)) {
+        return 0;
+    }
+
+    baselineEntry* cur = b->entries + b->count;
+    memset(cur, 0, sizeof(*cur));
+    cur->name    = b->names_len;
+    cur->time_ns = json_u64(line, "time_ns");
+    // Written by --history, the jsonl reporter only has the result.
+    const char* result = json_find(line, "result");
+    cur->since_fail = BASELINE_NEVER_FAILED;
+    if(json_find(line, "since_fail") != NULL) {
+        uint64_t since = json_u64(line, "since_fail");
+        cur->since_fail = since < BASELINE_NEVER_FAILED ? (uint32_t)since : BASELINE_NEVER_FAILED;
+    } else if(result != NULL && strncmp(result, "\"failed\"", 8) == 0) {
+        cur->since_fail = 0;
+    }
+    if(json_find(line, "bench") != NULL) {
+        cur->bench.iters   = json_u64(line, "iters");
+        cur->bench.samples = json_u64(line, "samples");
+        cur->bench.min     = json_double(line, "min_ns");
+        cur->bench.median  = json_double(line, "median_ns");
+        cur->bench.mean    = json_double(line, "mean_ns");
+        cur->bench.stddev  = json_double(line, "stddev_ns");
+        cur->bench.p99     = json_double(line, "p99_ns");
+        cur->bench.cycles  = json_double(line, "cycles");
+    }
+    b->names_len += strlen(b->names + b->names_len) + 1;
+    b->count++;
+    return 0;
+}
+
+int baseline_load(baselineFile* b, const char* path) {
+    FILE* file = fopen(path, "r");
+    if(file == NULL) {
+        return 1;
+    }
+    int  ret = 0;
+    char line[4096];
+    while(!ret && fgets(line, sizeof(line), file) != NULL) {
+        ret = baseline_add_line(b, line);
+    }
+    if(ferror(file)) {
+        ret = 1;
+    }
+    fclose(file);
+
+    // The names only stop moving once everything is read.
+    if(ret == 0 && name_index_init(&(b->index), b->count) == 0) {
+        for(size_t i = 0; i < b->count; i++) {
+            name_index_add(&(b->index), b->names + b->entries[i].name, i);
+        }
+    }
+    return ret;
+}
+
+const baselineEntry* baseline_find(const baselineFile* b, const char* name) {
+    size_t id = 0;
+    if(name_index_find(&(b->index), name, &id)) {
+        return b->entries + id;
+    }
+    return NULL;
+}
+
+void baseline_free(baselineFile* b) {
+    name_index_free(&(b->index));
+    free(b->entries);
+    free(b->names);
+    memset(b, 0, sizeof(*b));
+}
+
+// Standard error of the median of samples drawn from a normal distribution.
+static double median_error(const benchStats* stats) {
+    if(stats->samples == 0) {
+        return 0;
+    }
+    return stats->stddev * 12533 / 10000 / sqrt(stats->samples);
+}
+
+static void baseline_compare(baselineState* st, outputInfo* out, const caseReport* c) {
+    const benchStats*    cur = &(c->res->bench);
+    const baselineEntry* old = baseline_find(&(st->old), c->name);
+    const char*          clr = out->fg.l_magenta;
+    int                  regressed  = 0;
+    char                 buffer[14] = "new";
+
+    if(old != NULL && old->bench.samples > 0 && old->bench.median > 0) {
+        double delta = cur->median - old->bench.median;
+        double eo    = median_error(&(old->bench));
+        double ec    = median_error(cur);
+        // Needs to be past both the threshold and the noise of the two
+        // runs, about a 95% confidence interval.
+        double noise = 2 * sqrt(eo * eo + ec * ec);
+        double limit = old->bench.median * st->threshold;
+        snprintf(buffer, sizeof(buffer), "%+.1f%%", delta * 100 / old->bench.median);
+        if(delta > limit && delta > noise) {
+            clr       = out->fg.l_red;
+            regressed = 1;
+            st->regressions++;
+        } else if(-delta > limit && -delta > noise) {
+            clr = out->fg.l_green;
+        }
+    }
+    fprintf(
+        out->output,
+        "[   %sBaseline%s : %s%-13s%s]\n",
+        out->fg.l_yellow,
+        out->reset,
+        clr,
+        buffer,
+        out->reset
+    );
+    if(regressed) {
+        char now[14];
+        char was[14];
+        bench_format_ns(cur->median, now);
+        bench_format_ns(old->bench.median, was);
+        fprintf(out->output, "  %sRegression%s : median %s was %s\n", out->fg.l_red, out->reset, now, was);
+    }
+}
+
+// Kept with the timings so a comparison can be traced back to the machine
+// it was made on. Loading skips it as it has no case.
+static void baseline_suite_start(reporter* r, outputInfo* out, const char* suite, size_t count) {
+    (void)out;
+    (void)suite;
+    (void)count;
+    if(r->output != NULL) {
+        fputs("{\"machine\":", r->output);
+        report_write_json_machine(r->output, get_machine_info());
+        fputs("}\n", r->output);
+    }
+}
+
+static void baseline_case_end(reporter* r, outputInfo* out, const caseReport* c) {
+    baselineState* st = r->state;
+    if(r->output != NULL) {
+        fputs("{\"case\":", r->output);
+        report_write_json_str(r->output, c->name);
+        fprintf(r->output, ",\"time_ns\":%"PRIu64, timer_get_ns(&(c->res->time)));
+        if(c->res->bench.samples) {
+            report_write_json_bench(r->output, &(c->res->bench));
+        }
+        fputs("}\n", r->output);
+    }
+    if(st->comparing && c->res->bench.samples) {
+        baseline_compare(st, out, c);
+    }
+}
+
+static void baseline_summary(reporter* r, outputInfo* out, const runSummary* s) {
+    baselineState* st = r->state;
+    (void)s;
+    if(r->output != NULL) {
+        fflush(r->output);
+    }
+    if(!st->comparing) {
+        return;
+    }
+    fprintf(
+        out->output,
+        "Bench %sRegressions%s : %s%s%zu%s\n",
+        st->regressions ? out->fg.l_red : "",
+        out->reset,
+        st->regressions ? out->bold : "",
+        st->regressions ? out->fg.l_magenta : "",
+        st->regressions,
+        out->reset
+    );
+}
+
+static void baseline_close(reporter* r) {
+    baselineState* st = r->state;
+    if(st != NULL) {
+        baseline_free(&(st->old));
+        free(st);
+    }
+    r->state = NULL;
+}
+
+static const reporterOps baseline_ops = {
+    .suite_start = baseline_suite_start,
+    .case_end    = baseline_case_end,
+    .summary     = baseline_summary,
+    .close       = baseline_close
+};
+
+int baseline_reporter_init(reporter* r, const char* save_path, const char* compare_path, double threshold) {
+    baselineState* st = calloc(1, sizeof(baselineState));
+    memset(r, 0, sizeof(*r));
+    if(st == NULL) {
+        return compare_path != NULL ? 1 : 2;
+    }
+    st->threshold = threshold;
+    // Read before opening the new one so both can be the same file.
+    if(compare_path != NULL) {
+        if(baseline_load(&(st->old), compare_path)) {
+            baseline_free(&(st->old));
+            free(st);
+            return 1;
+        }
+        st->comparing = 1;
+    }
+    if(save_path != NULL) {
+        r->output = fopen(save_path, "w");
+        if(r->output == NULL) {
+            baseline_free(&(st->old));
+            free(st);
+            return 2;
+        }
+        r->close_output = 1;
+    }
+    r->ops   = &baseline_ops;
+    r->state = st;
+    return 0;
+}
+
+size_t baseline_regressions(const reporter* r) {
+    const baselineState* st = r->state;
+    return st != NULL ? st->regressions : 0;
+}
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "timer.h"
+#include "sys-info.h"
+
+// Used when the size of the last level cache isn't known, and the most
+// that is ever thrashed so a huge reported cache doesn't take forever.
+#define BENCH_THRASH_DEFAULT (64U << 20)
+#define BENCH_THRASH_MAX     (256U << 20)
+
+// Returns the time the batch took in nano seconds.
+static double bench_batch(kTestStatus* stat, tcFn fn, void* fix, uint64_t iters) {
+    cycleData t = { 0 };
+    cycle_timer_start(&t);
+    for(uint64_t i = 0; i < iters && !stat->result; i++) {
+        fn(stat, fix);
+    }
+    cycle_timer_stop(&t);
+    uint64_t cycles = cycle_timer_get_cycles(&t);
+    return cycles * timer_ns_per_cycle();
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void bench_compute_stats(double* samples, size_t count, benchStats* stats) {
+    if(count == 0) {
+        stats->samples = 0;
+        return;
+    }
+    qsort(samples, count, sizeof(double), cmp_double);
+
+    double sum = 0;
+    for(size_t i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    double mean = sum / count;
+    double var  = 0;
+    for(size_t i = 0; i < count; i++) {
+        var += (samples[i] - mean) * (samples[i] - mean);
+    }
+    if(count > 1) {
+        var /= count - 1;
+    }
+
+    stats->samples = count;
+    stats->min     = samples[0];
+    stats->median  = count & 1 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    stats->mean    = mean;
+    stats->stddev  = sqrt(var);
+    // Nearest rank
+    stats->p99     = samples[(count * 99 + 99) / 100 - 1];
+}
+
+// Half as much again as the last level cache is enough to push out
+// anything the body left in it.
+static size_t bench_thrash_size() {
+    const machineInfo* m    = get_machine_info();
+    size_t             size = m->l3_size ? m->l3_size : m->l2_size;
+    size = size ? size + size / 2 : BENCH_THRASH_DEFAULT;
+    return size < BENCH_THRASH_MAX ? size : BENCH_THRASH_MAX;
+}
+
+// One write per line is enough to claim it, the cache only holds whole
+// lines.
+static void bench_thrash(volatile unsigned char* buf, size_t len, size_t line) {
+    for(size_t i = 0; i < len; i += line) {
+        buf[i]++;
+    }
+}
+
+// The modified z-score of Iglewicz and Hoaglin, 0.6745 scales the MAD to
+// the standard deviation of a normal distribution. Samples are sorted on
+// the way. Returns how many are left.
+static size_t bench_drop_outliers(double* samples, size_t count, double limit) {
+    double dev[BENCH_MAX_SAMPLES];
+    qsort(samples, count, sizeof(double), cmp_double);
+    double median = count & 1 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    for(size_t i = 0; i < count; i++) {
+        dev[i] = fabs(samples[i] - median);
+    }
+    qsort(dev, count, sizeof(double), cmp_double);
+    double mad = count & 1 ? dev[count / 2] : (dev[count / 2 - 1] + dev[count / 2]) / 2;
+    // Over half the samples are the same, nothing can be told apart.
+    if(!(mad > 0)) {
+        return count;
+    }
+    size_t kept = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(fabs(samples[i] - median) * 6745 <= limit * mad * 10000) {
+            samples[kept++] = samples[i];
+        }
+    }
+    return kept;
+}
+
+// Each cold sample is a single call, timed after the thrash. Returns
+// non-zero if there was no memory to thrash with.
+static int bench_cold_samples(const benchConfig* cfg, kTestStatus* stat, tcFn fn, void* fix, double* samples, size_t count) {
+    size_t         len  = bench_thrash_size();
+    size_t         line = get_machine_info()->line_size;
+    unsigned char* buf  = calloc(len, 1);
+    if(buf == NULL) {
+        return 1;
+    }
+    line = line ? line : 64;
+    for(size_t i = 0; i < cfg->warmup && !stat->result; i++) {
+        bench_batch(stat, fn, fix, 1);
+    }
+    for(size_t i = 0; i < count; i++) {
+        bench_thrash(buf, len, line);
+        double ns = bench_batch(stat, fn, fix, 1);
+        if(stat->result) {
+            break;
+        }
+        samples[i] = ns;
+    }
+    free(buf);
+    return 0;
+}
+
+static void bench_measure(const benchConfig* cfg, kTestStatus* stat, tcFn fn, void* fix, benchStats* stats) {
+    double   samples[BENCH_MAX_SAMPLES];
+    size_t   count     = cfg->samples;
+    if(count == 0 || count > BENCH_MAX_SAMPLES) {
+        count = BENCH_MAX_SAMPLES;
+    }
+    uint64_t per_batch = cfg->target_ns / count;
+    uint64_t iters     = 1;
+
+    if(cfg->cold && bench_cold_samples(cfg, stat, fn, fix, samples, count) == 0) {
+        if(stat->result) {
+            return;
+        }
+        stats->applied |= BENCH_COLD | (cfg->warmup ? BENCH_WARMUP : 0);
+    } else {
+        // Keep growing the batch until a single one takes long enough that
+        // the cost of reading the clock no longer matters.
+        for(;;) {
+            double ns = bench_batch(stat, fn, fix, iters);
+            if(stat->result) {
+                return;
+            }
+            if(ns >= per_batch || iters >= (UINT64_C(1) << 40)) {
+                break;
+            }
+            // Aim a little past the target so the next batch usually ends the
+            // search, but never grow by more than 10x on a noisy reading.
+            uint64_t want = ns > 0 ? (uint64_t)(iters * (per_batch / ns)) + iters / 8 + 1 : iters * 10;
+            iters = want > iters * 10 ? iters * 10 : want;
+        }
+
+        for(size_t i = 0; i < cfg->warmup; i++) {
+            bench_batch(stat, fn, fix, iters);
+            if(stat->result) {
+                return;
+            }
+        }
+        stats->applied |= cfg->warmup ? BENCH_WARMUP : 0;
+
+        for(size_t i = 0; i < count; i++) {
+            double ns = bench_batch(stat, fn, fix, iters);
+            if(stat->result) {
+                return;
+            }
+            samples[i] = ns / iters;
+        }
+    }
+    if(cfg->mad_limit > 0) {
+        size_t kept = bench_drop_outliers(samples, count, cfg->mad_limit);
+        stats->outliers = count - kept;
+        stats->applied |= BENCH_MAD;
+        count = kept;
+    }
+    stats->iters = iters;
+    bench_compute_stats(samples, count, stats);
+    stats->cycles = stats->median / timer_ns_per_cycle();
+}
+
+void bench_run(const benchConfig* cfg, kTestStatus* stat, tcFn fn, void* fix, benchStats* stats) {
+    threadAffinity affinity = { 0 };
+    int            priority = 0;
+    stats->samples  = 0;
+    stats->applied  = 0;
+    stats->outliers = 0;
+    if(cfg->cpu >= 0 && pin_thread(cfg->cpu, &affinity) == 0) {
+        stats->applied |= BENCH_PINNED;
+        stats->cpu      = cfg->cpu;
+    }
+    if(cfg->priority) {
+        stats->priority = raise_thread_priority(&priority);
+        stats->applied |= stats->priority ? BENCH_PRIORITY : 0;
+    }
+
+    bench_measure(cfg, stat, fn, fix, stats);
+
+    if(stats->applied & BENCH_PRIORITY) {
+        restore_thread_priority(priority);
+    }
+    if(stats->applied & BENCH_PINNED) {
+        unpin_thread(&affinity);
+    }
+}
+
+// Above a microsecond the fraction of a nanosecond is not worth showing,
+// so it is formatted the same way as every other time.
+void bench_format_ns(double amt, char buffer[14]) {
+    if(amt >= 1000) {
+        timer_format_ns_u64((uint64_t)llround(amt), buffer);
+        return;
+    }
+    snprintf(buffer, 14, "%.2fns", amt);
+}
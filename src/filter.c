@@ -0,0 +1,192 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "filter.h"
+
+// FNV-1a
+static uint64_t name_hash(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325;
+    while(*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+int name_index_init(nameIndex* idx, size_t count) {
+    size_t cap = 16;
+    // Keep it at most half full so probes stay short.
+    while(cap < count * 2) {
+        cap *= 2;
+    }
+    idx->slots = calloc(cap, sizeof(nameSlot));
+    idx->mask  = cap - 1;
+    return idx->slots == NULL;
+}
+
+void name_index_add(nameIndex* idx, const char* name, size_t id) {
+    size_t i = name_hash(name) & idx->mask;
+    while(idx->slots[i].name != NULL) {
+        if(strcmp(idx->slots[i].name, name) == 0) {
+            return;
+        }
+        i = (i + 1) & idx->mask;
+    }
+    idx->slots[i].name = name;
+    idx->slots[i].id   = id;
+}
+
+int name_index_find(const nameIndex* idx, const char* name, size_t* id) {
+    if(idx->slots == NULL) {
+        return 0;
+    }
+    size_t i = name_hash(name) & idx->mask;
+    while(idx->slots[i].name != NULL) {
+        if(strcmp(idx->slots[i].name, name) == 0) {
+            *id = idx->slots[i].id;
+            return 1;
+        }
+        i = (i + 1) & idx->mask;
+    }
+    return 0;
+}
+
+void name_index_free(nameIndex* idx) {
+    free(idx->slots);
+    idx->slots = NULL;
+    idx->mask  = 0;
+}
+
+int glob_match(const char* pat, const char* str) {
+    // Only the last star ever needs to be backtracked to, so this stays
+    // linear in practice rather than exponential.
+    const char* star = NULL;
+    const char* back = NULL;
+    while(*str) {
+        if(*pat == '*') {
+            star = ++pat;
+            back = str;
+            continue;
+        }
+        if(*pat && (*pat == '?' || *pat == *str)) {
+            pat++;
+            str++;
+            continue;
+        }
+        if(star == NULL) {
+            return 0;
+        }
+        pat = star;
+        str = ++back;
+    }
+    while(*pat == '*') {
+        pat++;
+    }
+    return *pat == '\0';
+}
+
+int glob_has_wild(const char* pat) {
+    return strpbrk(pat, "*?") != NULL;
+}
+
+static int filter_push(filterList* f, const char* pat, size_t len) {
+    if(f->len + len + 1 > f->cap) {
+        size_t new_cap = f->cap ? f->cap : 256;
+        while(new_cap < f->len + len + 1) {
+            new_cap *= 2;
+        }
+        char* new = realloc(f->buf, new_cap);
+        if(new == NULL) {
+            return 1;
+        }
+        f->buf = new;
+        f->cap = new_cap;
+    }
+    memcpy(f->buf + f->len, pat, len);
+    f->buf[f->len + len] = '\0';
+    f->len += len + 1;
+    f->count++;
+    return 0;
+}
+
+int filter_add(filterList* f, const char* pats) {
+    while(*pats) {
+        size_t len = strcspn(pats, ":");
+        if(len > 0 && filter_push(f, pats, len)) {
+            return 1;
+        }
+        pats += len;
+        if(*pats == ':') {
+            pats++;
+        }
+    }
+    return 0;
+}
+
+// Reads a whole line however long it is, growing line as needed. Returns
+// 0 at the end of the file and -1 if growing failed.
+static int filter_read_line(FILE* file, char** line, size_t* cap) {
+    size_t len = 0;
+    for(;;) {
+        if(*cap - len < 2) {
+            size_t new_cap = *cap ? *cap * 2 : 256;
+            char*  new     = realloc(*line, new_cap);
+            if(new == NULL) {
+                return -1;
+            }
+            *line = new;
+            *cap  = new_cap;
+        }
+        if(fgets(*line + len, (int)(*cap - len), file) == NULL) {
+            return len > 0;
+        }
+        len += strlen(*line + len);
+        if(len > 0 && (*line)[len - 1] == '\n') {
+            return 1;
+        }
+    }
+}
+
+int filter_add_file(filterList* f, const char* path) {
+    FILE* file = fopen(path, "r");
+    if(file == NULL) {
+        return 1;
+    }
+    int    ret  = 0;
+    int    got  = 0;
+    char*  line = NULL;
+    size_t cap  = 0;
+    while(!ret && (got = filter_read_line(file, &line, &cap)) > 0) {
+        size_t len = strcspn(line, "\r\n");
+        // Drop trailing blanks so they don't become part of a name.
+        while(len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) {
+            len--;
+        }
+        line[len] = '\0';
+        if(len == 0 || line[0] == '#') {
+            continue;
+        }
+        ret = filter_add(f, line);
+    }
+    if(got < 0 || ferror(file)) {
+        ret = 1;
+    }
+    free(line);
+    fclose(file);
+    return ret;
+}
+
+const char* filter_next(const filterList* f, const char* cur) {
+    cur = cur == NULL ? f->buf : cur + strlen(cur) + 1;
+    return cur < f->buf + f->len ? cur : NULL;
+}
+
+void filter_free(filterList* f) {
+    free(f->buf);
+    f->buf   = NULL;
+    f->len   = 0;
+    f->cap   = 0;
+    f->count = 0;
+}
@@ -0,0 +1,375 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sys-info.h"
+#include "float-cmp.h"
+
+#if CURRENT_ARCH == X86_64 && defined(__GNUC__)
+    #include <immintrin.h>
+    #define FLOAT_CMP_X86
+#elif CURRENT_ARCH == ARM_64 && defined(__GNUC__) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define FLOAT_CMP_NEON
+#endif
+
+// The 32 bit lanes counting near elements are added up every this many
+// elements so they can't overflow.
+#define FLOAT_BLOCK (1u << 16)
+
+// Maps the bits of a float to integers that are in the same order as the
+// values, so the distance between two of them is the ULPs between them.
+static int32_t ulp_order_f32(float x) {
+    int32_t i;
+    memcpy(&i, &x, sizeof(i));
+    return i < 0 ? INT32_MIN - i : i;
+}
+
+static int64_t ulp_order_f64(double x) {
+    int64_t i;
+    memcpy(&i, &x, sizeof(i));
+    return i < 0 ? INT64_MIN - i : i;
+}
+
+static uint32_t ulp_dist_f32(float a, float e) {
+    int32_t x = ulp_order_f32(a);
+    int32_t y = ulp_order_f32(e);
+    return x > y ? (uint32_t)x - (uint32_t)y : (uint32_t)y - (uint32_t)x;
+}
+
+static uint64_t ulp_dist_f64(double a, double e) {
+    int64_t x = ulp_order_f64(a);
+    int64_t y = ulp_order_f64(e);
+    return x > y ? (uint64_t)x - (uint64_t)y : (uint64_t)y - (uint64_t)x;
+}
+
+// The scalar loops finish whatever the vector ones leave over, so they
+// have to decide exactly the same way, floats are kept as floats.
+static size_t far_f32_scalar(const float* a, const float* e, size_t i, size_t n, float abs_tol, float rel_tol) {
+    size_t far = 0;
+    for(; i < n; i++) {
+        float d = fabsf(a[i] - e[i]);
+        far += !(a[i] == e[i] || (d <= abs_tol + rel_tol * fabsf(e[i]) && d < HUGE_VALF));
+    }
+    return far;
+}
+
+static size_t far_f64_scalar(const double* a, const double* e, size_t i, size_t n, double abs_tol, double rel_tol) {
+    size_t far = 0;
+    for(; i < n; i++) {
+        double d = fabs(a[i] - e[i]);
+        far += !(a[i] == e[i] || (d <= abs_tol + rel_tol * fabs(e[i]) && d < HUGE_VAL));
+    }
+    return far;
+}
+
+static size_t ulp_far_f32_scalar(const float* a, const float* e, size_t i, size_t n, uint32_t ulps) {
+    size_t far = 0;
+    for(; i < n; i++) {
+        far += ulp_dist_f32(a[i], e[i]) > ulps || a[i] != a[i] || e[i] != e[i];
+    }
+    return far;
+}
+
+static size_t ulp_far_f64_scalar(const double* a, const double* e, size_t i, size_t n, uint64_t ulps) {
+    size_t far = 0;
+    for(; i < n; i++) {
+        far += ulp_dist_f64(a[i], e[i]) > ulps || a[i] != a[i] || e[i] != e[i];
+    }
+    return far;
+}
+
+static size_t block_end(size_t i, size_t n) {
+    return n - i > FLOAT_BLOCK ? i + FLOAT_BLOCK : n;
+}
+
+#if defined(FLOAT_CMP_X86)
+// Every lane of a compare is all ones when it held, so subtracting the
+// masks counts the near elements without a branch.
+static size_t sum_epi32(__m128i v) {
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, v);
+    return (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static size_t far_f32_sse2(const float* a, const float* e, size_t n, float abs_tol, float rel_tol) {
+    const __m128 mag = _mm_castsi128_ps(_mm_set1_epi32(INT32_MAX));
+    const __m128 va  = _mm_set1_ps(abs_tol);
+    const __m128 vr  = _mm_set1_ps(rel_tol);
+    const __m128 inf = _mm_set1_ps(HUGE_VALF);
+    size_t near = 0;
+    size_t i    = 0;
+    while(n - i >= 4) {
+        size_t  end = block_end(i, n);
+        __m128i ok  = _mm_setzero_si128();
+        for(; end - i >= 4; i += 4) {
+            __m128 x     = _mm_loadu_ps(a + i);
+            __m128 y     = _mm_loadu_ps(e + i);
+            __m128 d     = _mm_and_ps(_mm_sub_ps(x, y), mag);
+            __m128 bound = _mm_add_ps(va, _mm_mul_ps(vr, _mm_and_ps(y, mag)));
+            __m128 in    = _mm_and_ps(_mm_cmple_ps(d, bound), _mm_cmplt_ps(d, inf));
+            ok = _mm_sub_epi32(ok, _mm_castps_si128(_mm_or_ps(_mm_cmpeq_ps(x, y), in)));
+        }
+        near += sum_epi32(ok);
+    }
+    return i - near + far_f32_scalar(a, e, i, n, abs_tol, rel_tol);
+}
+
+static size_t far_f64_sse2(const double* a, const double* e, size_t n, double abs_tol, double rel_tol) {
+    const __m128d mag = _mm_castsi128_pd(_mm_set1_epi64x(INT64_MAX));
+    const __m128d va  = _mm_set1_pd(abs_tol);
+    const __m128d vr  = _mm_set1_pd(rel_tol);
+    const __m128d inf = _mm_set1_pd(HUGE_VAL);
+    __m128i ok = _mm_setzero_si128();
+    size_t  i  = 0;
+    for(; n - i >= 2; i += 2) {
+        __m128d x     = _mm_loadu_pd(a + i);
+        __m128d y     = _mm_loadu_pd(e + i);
+        __m128d d     = _mm_and_pd(_mm_sub_pd(x, y), mag);
+        __m128d bound = _mm_add_pd(va, _mm_mul_pd(vr, _mm_and_pd(y, mag)));
+        __m128d in    = _mm_and_pd(_mm_cmple_pd(d, bound), _mm_cmplt_pd(d, inf));
+        ok = _mm_sub_epi64(ok, _mm_castpd_si128(_mm_or_pd(_mm_cmpeq_pd(x, y), in)));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, ok);
+    return i - (size_t)(lanes[0] + lanes[1]) + far_f64_scalar(a, e, i, n, abs_tol, rel_tol);
+}
+
+static __m128i ulp_order_sse2(__m128 x) {
+    __m128i i = _mm_castps_si128(x);
+    __m128i s = _mm_srai_epi32(i, 31);
+    __m128i m = _mm_and_si128(i, _mm_set1_epi32(INT32_MAX));
+    return _mm_sub_epi32(_mm_xor_si128(m, s), s);
+}
+
+static size_t ulp_far_f32_sse2(const float* a, const float* e, size_t n, uint32_t ulps) {
+    // SSE2 only compares signed, flipping the top bit compares unsigned.
+    const __m128i bias = _mm_set1_epi32(INT32_MIN);
+    const __m128i lim  = _mm_set1_epi32((int32_t)(ulps ^ 0x80000000u));
+    size_t near = 0;
+    size_t i    = 0;
+    while(n - i >= 4) {
+        size_t  end = block_end(i, n);
+        __m128i ok  = _mm_setzero_si128();
+        for(; end - i >= 4; i += 4) {
+            __m128  x    = _mm_loadu_ps(a + i);
+            __m128  y    = _mm_loadu_ps(e + i);
+            __m128i ox   = ulp_order_sse2(x);
+            __m128i oy   = ulp_order_sse2(y);
+            __m128i neg  = _mm_cmpgt_epi32(oy, ox);
+            __m128i d    = _mm_sub_epi32(_mm_xor_si128(_mm_sub_epi32(ox, oy), neg), neg);
+            __m128i over = _mm_cmpgt_epi32(_mm_xor_si128(d, bias), lim);
+            __m128i num  = _mm_castps_si128(_mm_cmpord_ps(x, y));
+            ok = _mm_sub_epi32(ok, _mm_andnot_si128(over, num));
+        }
+        near += sum_epi32(ok);
+    }
+    return i - near + ulp_far_f32_scalar(a, e, i, n, ulps);
+}
+
+// SSE2 has no 64 bit compare, so doubles need AVX2 to go wide.
+__attribute__((target("avx2")))
+static __m256i ulp_order_avx2(__m256d x) {
+    __m256i i = _mm256_castpd_si256(x);
+    __m256i s = _mm256_cmpgt_epi64(_mm256_setzero_si256(), i);
+    __m256i m = _mm256_and_si256(i, _mm256_set1_epi64x(INT64_MAX));
+    return _mm256_sub_epi64(_mm256_xor_si256(m, s), s);
+}
+
+__attribute__((target("avx2")))
+static size_t ulp_far_f64_avx2(const double* a, const double* e, size_t n, uint64_t ulps) {
+    const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i lim  = _mm256_xor_si256(_mm256_set1_epi64x((long long)ulps), bias);
+    __m256i ok = _mm256_setzero_si256();
+    size_t  i  = 0;
+    for(; n - i >= 4; i += 4) {
+        __m256d x    = _mm256_loadu_pd(a + i);
+        __m256d y    = _mm256_loadu_pd(e + i);
+        __m256i ox   = ulp_order_avx2(x);
+        __m256i oy   = ulp_order_avx2(y);
+        __m256i neg  = _mm256_cmpgt_epi64(oy, ox);
+        __m256i d    = _mm256_sub_epi64(_mm256_xor_si256(_mm256_sub_epi64(ox, oy), neg), neg);
+        __m256i over = _mm256_cmpgt_epi64(_mm256_xor_si256(d, bias), lim);
+        __m256i num  = _mm256_castpd_si256(_mm256_cmp_pd(x, y, _CMP_ORD_Q));
+        ok = _mm256_sub_epi64(ok, _mm256_andnot_si256(over, num));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, ok);
+    return i - (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + ulp_far_f64_scalar(a, e, i, n, ulps);
+}
+#endif
+
+#if defined(FLOAT_CMP_NEON)
+static size_t far_f32_neon(const float* a, const float* e, size_t n, float abs_tol, float rel_tol) {
+    const float32x4_t va  = vdupq_n_f32(abs_tol);
+    const float32x4_t vr  = vdupq_n_f32(rel_tol);
+    const float32x4_t inf = vdupq_n_f32(HUGE_VALF);
+    size_t near = 0;
+    size_t i    = 0;
+    while(n - i >= 4) {
+        size_t     end = block_end(i, n);
+        uint32x4_t ok  = vdupq_n_u32(0);
+        for(; end - i >= 4; i += 4) {
+            float32x4_t x     = vld1q_f32(a + i);
+            float32x4_t y     = vld1q_f32(e + i);
+            float32x4_t d     = vabdq_f32(x, y);
+            float32x4_t bound = vaddq_f32(va, vmulq_f32(vr, vabsq_f32(y)));
+            uint32x4_t  in    = vandq_u32(vcleq_f32(d, bound), vcltq_f32(d, inf));
+            ok = vsubq_u32(ok, vorrq_u32(vceqq_f32(x, y), in));
+        }
+        near += vaddvq_u32(ok);
+    }
+    return i - near + far_f32_scalar(a, e, i, n, abs_tol, rel_tol);
+}
+
+static size_t far_f64_neon(const double* a, const double* e, size_t n, double abs_tol, double rel_tol) {
+    const float64x2_t va  = vdupq_n_f64(abs_tol);
+    const float64x2_t vr  = vdupq_n_f64(rel_tol);
+    const float64x2_t inf = vdupq_n_f64(HUGE_VAL);
+    uint64x2_t ok = vdupq_n_u64(0);
+    size_t     i  = 0;
+    for(; n - i >= 2; i += 2) {
+        float64x2_t x     = vld1q_f64(a + i);
+        float64x2_t y     = vld1q_f64(e + i);
+        float64x2_t d     = vabdq_f64(x, y);
+        float64x2_t bound = vaddq_f64(va, vmulq_f64(vr, vabsq_f64(y)));
+        uint64x2_t  in    = vandq_u64(vcleq_f64(d, bound), vcltq_f64(d, inf));
+        ok = vsubq_u64(ok, vorrq_u64(vceqq_f64(x, y), in));
+    }
+    return i - (size_t)vaddvq_u64(ok) + far_f64_scalar(a, e, i, n, abs_tol, rel_tol);
+}
+
+static size_t ulp_far_f32_neon(const float* a, const float* e, size_t n, uint32_t ulps) {
+    const uint32x4_t lim = vdupq_n_u32(ulps);
+    const int32x4_t  mag = vdupq_n_s32(INT32_MAX);
+    size_t near = 0;
+    size_t i    = 0;
+    while(n - i >= 4) {
+        size_t     end = block_end(i, n);
+        uint32x4_t ok  = vdupq_n_u32(0);
+        for(; end - i >= 4; i += 4) {
+            float32x4_t x  = vld1q_f32(a + i);
+            float32x4_t y  = vld1q_f32(e + i);
+            int32x4_t   ix = vreinterpretq_s32_f32(x);
+            int32x4_t   iy = vreinterpretq_s32_f32(y);
+            int32x4_t   sx = vshrq_n_s32(ix, 31);
+            int32x4_t   sy = vshrq_n_s32(iy, 31);
+            int32x4_t   ox = vsubq_s32(veorq_s32(vandq_s32(ix, mag), sx), sx);
+            int32x4_t   oy = vsubq_s32(veorq_s32(vandq_s32(iy, mag), sy), sy);
+            // The difference wraps but read as unsigned it's exact.
+            uint32x4_t  d    = vreinterpretq_u32_s32(vabdq_s32(ox, oy));
+            uint32x4_t  num  = vandq_u32(vceqq_f32(x, x), vceqq_f32(y, y));
+            ok = vsubq_u32(ok, vbicq_u32(num, vcgtq_u32(d, lim)));
+        }
+        near += vaddvq_u32(ok);
+    }
+    return i - near + ulp_far_f32_scalar(a, e, i, n, ulps);
+}
+
+static size_t ulp_far_f64_neon(const double* a, const double* e, size_t n, uint64_t ulps) {
+    const uint64x2_t lim = vdupq_n_u64(ulps);
+    const int64x2_t  mag = vdupq_n_s64(INT64_MAX);
+    uint64x2_t ok = vdupq_n_u64(0);
+    size_t     i  = 0;
+    for(; n - i >= 2; i += 2) {
+        float64x2_t x   = vld1q_f64(a + i);
+        float64x2_t y   = vld1q_f64(e + i);
+        int64x2_t   ix  = vreinterpretq_s64_f64(x);
+        int64x2_t   iy  = vreinterpretq_s64_f64(y);
+        int64x2_t   sx  = vshrq_n_s64(ix, 63);
+        int64x2_t   sy  = vshrq_n_s64(iy, 63);
+        int64x2_t   ox  = vsubq_s64(veorq_s64(vandq_s64(ix, mag), sx), sx);
+        int64x2_t   oy  = vsubq_s64(veorq_s64(vandq_s64(iy, mag), sy), sy);
+        int64x2_t   neg = vreinterpretq_s64_u64(vcgtq_s64(oy, ox));
+        uint64x2_t  d   = vreinterpretq_u64_s64(vsubq_s64(veorq_s64(vsubq_s64(ox, oy), neg), neg));
+        uint64x2_t  num = vandq_u64(vceqq_f64(x, x), vceqq_f64(y, y));
+        ok = vsubq_u64(ok, vbicq_u64(num, vcgtq_u64(d, lim)));
+    }
+    return i - (size_t)vaddvq_u64(ok) + ulp_far_f64_scalar(a, e, i, n, ulps);
+}
+#endif
+
+size_t float_far_f32(const float* a, const float* e, size_t n, double abs_tol, double rel_tol) {
+    float at = (float)abs_tol;
+    float rt = (float)rel_tol;
+    #if defined(FLOAT_CMP_X86)
+    return far_f32_sse2(a, e, n, at, rt);
+    #elif defined(FLOAT_CMP_NEON)
+    return far_f32_neon(a, e, n, at, rt);
+    #else
+    return far_f32_scalar(a, e, 0, n, at, rt);
+    #endif
+}
+
+size_t float_far_f64(const double* a, const double* e, size_t n, double abs_tol, double rel_tol) {
+    #if defined(FLOAT_CMP_X86)
+    return far_f64_sse2(a, e, n, abs_tol, rel_tol);
+    #elif defined(FLOAT_CMP_NEON)
+    return far_f64_neon(a, e, n, abs_tol, rel_tol);
+    #else
+    return far_f64_scalar(a, e, 0, n, abs_tol, rel_tol);
+    #endif
+}
+
+size_t float_ulp_far_f32(const float* a, const float* e, size_t n, uint64_t ulps) {
+    uint32_t lim = ulps > UINT32_MAX ? UINT32_MAX : (uint32_t)ulps;
+    #if defined(FLOAT_CMP_X86)
+    return ulp_far_f32_sse2(a, e, n, lim);
+    #elif defined(FLOAT_CMP_NEON)
+    return ulp_far_f32_neon(a, e, n, lim);
+    #else
+    return ulp_far_f32_scalar(a, e, 0, n, lim);
+    #endif
+}
+
+size_t float_ulp_far_f64(const double* a, const double* e, size_t n, uint64_t ulps) {
+    #if defined(FLOAT_CMP_X86)
+    if(__builtin_cpu_supports("avx2")) {
+        return ulp_far_f64_avx2(a, e, n, ulps);
+    }
+    return ulp_far_f64_scalar(a, e, 0, n, ulps);
+    #elif defined(FLOAT_CMP_NEON)
+    return ulp_far_f64_neon(a, e, n, ulps);
+    #else
+    return ulp_far_f64_scalar(a, e, 0, n, ulps);
+    #endif
+}
+
+static void float_stats_add(floatStats* st, size_t i, double x, double y, uint64_t ulp) {
+    double abs_err = 0;
+    double rel_err = 0;
+    if(x != x || y != y) {
+        abs_err = HUGE_VAL;
+        rel_err = HUGE_VAL;
+        ulp     = UINT64_MAX;
+    } else if(x != y) {
+        abs_err = fabs(x - y);
+        rel_err = y != 0 ? abs_err / fabs(y) : HUGE_VAL;
+    }
+    if(abs_err > st->max_abs) {
+        st->max_abs = abs_err;
+        st->at_abs  = i;
+    }
+    if(rel_err > st->max_rel) {
+        st->max_rel = rel_err;
+        st->at_rel  = i;
+    }
+    if(ulp > st->max_ulp) {
+        st->max_ulp = ulp;
+        st->at_ulp  = i;
+    }
+}
+
+void float_stats_f32(const float* a, const float* e, size_t n, floatStats* st) {
+    memset(st, 0, sizeof(*st));
+    for(size_t i = 0; i < n; i++) {
+        float_stats_add(st, i, (double)a[i], (double)e[i], ulp_dist_f32(a[i], e[i]));
+    }
+}
+
+void float_stats_f64(const double* a, const double* e, size_t n, floatStats* st) {
+    memset(st, 0, sizeof(*st));
+    for(size_t i = 0; i < n; i++) {
+        float_stats_add(st, i, a[i], e[i], ulp_dist_f64(a[i], e[i]));
+    }
+}
@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ktest.h"
+#include "golden.h"
+#include "mem-cmp.h"
+#include "console.h"
+#include "reporter.h"
+#include "sys-info.h"
+
+#if CURRENT_OS == OS_WINDOWS
+    #include <windows.h>
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+// The reference file mapped read-only, data points at an empty string for
+// an empty file as there is nothing to map.
+typedef struct {
+    const unsigned char* data;
+    size_t               size;
+    #if CURRENT_OS == OS_WINDOWS
+    HANDLE               file;
+    HANDLE               mapping;
+    #endif
+} goldenMap;
+
+static int golden_update = 0;
+
+void golden_configure(int update) {
+    golden_update = update;
+}
+
+#if CURRENT_OS == OS_WINDOWS
+static int golden_map(goldenMap* m, const char* path) {
+    LARGE_INTEGER size = { 0 };
+    memset(m, 0, sizeof(*m));
+    m->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(m->file == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+    if(!GetFileSizeEx(m->file, &size) || (uint64_t)size.QuadPart > SIZE_MAX) {
+        CloseHandle(m->file);
+        return 1;
+    }
+    m->size = (size_t)size.QuadPart;
+    m->data = (const unsigned char*)"";
+    if(m->size == 0) {
+        return 0;
+    }
+    m->mapping = CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(m->mapping == NULL) {
+        CloseHandle(m->file);
+        return 1;
+    }
+    m->data = MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    if(m->data == NULL) {
+        CloseHandle(m->mapping);
+        CloseHandle(m->file);
+        return 1;
+    }
+    return 0;
+}
+
+static void golden_unmap(goldenMap* m) {
+    if(m->size) {
+        UnmapViewOfFile(m->data);
+        CloseHandle(m->mapping);
+    }
+    CloseHandle(m->file);
+}
+
+// MoveFileEx replaces the old file in one step, anyone reading it sees
+// either the old or the new one.
+static int golden_write(const char* path, const void* buf, size_t len) {
+    size_t plen = strlen(path);
+    char*  tmp  = malloc(plen + sizeof(".tmp"));
+    if(tmp == NULL) {
+        return 1;
+    }
+    memcpy(tmp, path, plen);
+    memcpy(tmp + plen, ".tmp", sizeof(".tmp"));
+    FILE* file = fopen(tmp, "wb");
+    int   ret  = file == NULL;
+    if(file != NULL) {
+        ret  = fwrite(buf, 1, len, file) != len;
+        ret |= fclose(file) != 0;
+    }
+    if(!ret && !MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        ret = 1;
+    }
+    if(ret) {
+        remove(tmp);
+    }
+    free(tmp);
+    return ret;
+}
+#else
+static int golden_map(goldenMap* m, const char* path) {
+    struct stat st;
+    memset(m, 0, sizeof(*m));
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return 1;
+    }
+    if(fstat(fd, &st) != 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        return 1;
+    }
+    m->size = (size_t)st.st_size;
+    m->data = (const unsigned char*)"";
+    if(m->size > 0) {
+        void* data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) {
+            close(fd);
+            return 1;
+        }
+        // It is read once front to back.
+        posix_madvise(data, m->size, POSIX_MADV_SEQUENTIAL);
+        m->data = data;
+    }
+    // The mapping keeps the file open on it's own.
+    close(fd);
+    return 0;
+}
+
+static void golden_unmap(goldenMap* m) {
+    if(m->size) {
+        munmap((void*)m->data, m->size);
+    }
+}
+
+static int golden_write_all(int fd, const unsigned char* buf, size_t len) {
+    while(len > 0) {
+        ssize_t amt = write(fd, buf, len);
+        if(amt < 0 && errno == EINTR) {
+            continue;
+        }
+        if(amt <= 0) {
+            return 1;
+        }
+        buf += amt;
+        len -= (size_t)amt;
+    }
+    return 0;
+}
+
+// Written to a temporary file next to it first which is then renamed over
+// it, so a reader sees either the old file or the new one in full, never
+// a half written one. The mode of the old file is kept.
+static int golden_write(const char* path, const void* buf, size_t len) {
+    struct stat st;
+    size_t      plen = strlen(path);
+    char*       tmp  = malloc(plen + sizeof(".XXXXXX"));
+    if(tmp == NULL) {
+        return 1;
+    }
+    memcpy(tmp, path, plen);
+    memcpy(tmp + plen, ".XXXXXX", sizeof(".XXXXXX"));
+    int fd = mkstemp(tmp);
+    if(fd < 0) {
+        free(tmp);
+        return 1;
+    }
+    mode_t mode = stat(path, &st) == 0 ? st.st_mode & 07777 : 0644;
+    int    ret  = fchmod(fd, mode) != 0;
+    ret |= golden_write_all(fd, buf, len);
+    ret |= fsync(fd) != 0;
+    ret |= close(fd) != 0;
+    if(!ret && rename(tmp, path) != 0) {
+        ret = 1;
+    }
+    if(ret) {
+        unlink(tmp);
+    }
+    free(tmp);
+    return ret;
+}
+#endif
+
+static void golden_print_head(FILE* out, const char* file, unsigned line, const char* path, size_t size) {
+    fprintf(out, "Test Failure : %s:%u\n", file, line);
+    fprintf(out, "    Expected : %zu bytes from %s\n", size, path);
+}
+
+static int golden_missing(FILE* out, const char* file, unsigned line, const char* path) {
+    ktest_report_failure(file, line, "Expected : golden file %s, Actual : it can't be read", path);
+    if(out == NULL) {
+        return 1;
+    }
+    fprintf(out, "Test Failure : %s:%u\n", file, line);
+    fprintf(out, "    Expected : golden file %s\n", path);
+    fprintf(out, "      Actual : %s%s%s\n", get_fg_color_if_tty(L_RED, out), "it can't be read", get_reset_if_tty(out));
+    fprintf(out, "      Update : rerun with --update-golden to write it\n\n");
+    return 1;
+}
+
+// Only what the mismatch comes down to goes to the reporters, the rows
+// around it are for the console.
+static int golden_differs(FILE* out, const char* file, unsigned line, const char* path, const goldenMap* m, const void* buf, size_t len, size_t at) {
+    size_t common = len < m->size ? len : m->size;
+    if(at < common) {
+        const unsigned char* a = buf;
+        ktest_report_failure(
+            file,
+            line,
+            "Expected : %zu bytes from %s, Actual : 0x%02x at %zu where 0x%02x was expected",
+            m->size,
+            path,
+            a[at],
+            at,
+            m->data[at]
+        );
+    } else {
+        ktest_report_failure(file, line, "Expected : %zu bytes from %s, Actual : %zu bytes", m->size, path, len);
+    }
+    if(out == NULL) {
+        return 1;
+    }
+    golden_print_head(out, file, line, path, m->size);
+    if(at < common) {
+        fprintf(out, "      Actual : %zu bytes, differs at offset %zu (0x%zx)\n", len, at, at);
+    } else {
+        fprintf(out, "      Actual : %zu bytes, the first %zu are the same\n", len, common);
+    }
+    if(common > 0) {
+        mem_print_diff(out, buf, m->data, common, at < common ? at : common - 1);
+    }
+    fprintf(out, "      Update : rerun with --update-golden if this is intended\n\n");
+    return 1;
+}
+
+int ktest_golden(FILE* out, const char* file, unsigned line, const void* buf, size_t len, const char* path) {
+    goldenMap m;
+    if(buf == NULL && len > 0) {
+        ktest_report_failure(file, line, "Expected : %zu bytes to check against %s, Actual : NULL buffer", len, path);
+        if(out != NULL) {
+            fprintf(out, "Test Failure : %s:%u\n", file, line);
+            fprintf(out, "    Expected : %zu bytes to check against %s\n", len, path);
+            fprintf(out, "      Actual : %s%s%s buffer\n\n", get_fg_color_if_tty(L_RED, out), "NULL", get_reset_if_tty(out));
+        }
+        return 1;
+    }
+    int    mapped = golden_map(&m, path) == 0;
+    size_t at     = 0;
+    if(mapped) {
+        at = mem_mismatch(buf, m.data, len < m.size ? len : m.size);
+        if(at == len && len == m.size) {
+            golden_unmap(&m);
+            return 0;
+        }
+    }
+    if(!golden_update) {
+        int ret = mapped ? golden_differs(out, file, line, path, &m, buf, len, at) : golden_missing(out, file, line, path);
+        if(mapped) {
+            golden_unmap(&m);
+        }
+        return ret;
+    }
+
+    // Unmapped before writing as Windows won't replace a mapped file.
+    if(mapped) {
+        golden_unmap(&m);
+    }
+    if(golden_write(path, len ? buf : "", len)) {
+        ktest_report_failure(file, line, "Expected : golden file %s updated, Actual : it can't be written", path);
+        if(out != NULL) {
+            fprintf(out, "Test Failure : %s:%u\n", file, line);
+            fprintf(out, "    Expected : golden file %s updated\n", path);
+            fprintf(out, "      Actual : %s%s%s\n\n", get_fg_color_if_tty(L_RED, out), "it can't be written", get_reset_if_tty(out));
+        }
+        return 1;
+    }
+    if(out != NULL) {
+        fprintf(out, "      Golden : %s updated with %zu bytes\n\n", path, len);
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "guard-alloc.h"
+#include "sys-info.h"
+
+#if CURRENT_OS == OS_WINDOWS
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+#endif
+
+// A free mapping keeps the link to the next one of the same size in it's
+// first bytes.
+typedef struct guard_free_s {
+    struct guard_free_s* next;
+} guardFree;
+
+static guardFree*      guard_pool[GUARD_POOL_PAGES];
+static pthread_mutex_t guard_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Not rounded up, the block ends right at the guard page. The size of a
+// type is a multiple of it's alignment and the guard page is page aligned,
+// so a block for any one type is still aligned for it.
+static size_t guard_round(size_t size) {
+    return size ? size : 1;
+}
+
+#if CURRENT_OS == OS_WINDOWS
+static void* guard_map(size_t pages, size_t page) {
+    DWORD old  = 0;
+    char* base = VirtualAlloc(NULL, (pages + 1) * page, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if(base == NULL) {
+        return NULL;
+    }
+    if(!VirtualProtect(base + pages * page, page, PAGE_NOACCESS, &old)) {
+        VirtualFree(base, 0, MEM_RELEASE);
+        return NULL;
+    }
+    return base;
+}
+
+static void guard_unmap(void* base, size_t pages, size_t page) {
+    (void)pages;
+    (void)page;
+    VirtualFree(base, 0, MEM_RELEASE);
+}
+#else
+static void* guard_map(size_t pages, size_t page) {
+    char* base = mmap(NULL, (pages + 1) * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED) {
+        return NULL;
+    }
+    if(mprotect(base + pages * page, page, PROT_NONE) != 0) {
+        munmap(base, (pages + 1) * page);
+        return NULL;
+    }
+    return base;
+}
+
+static void guard_unmap(void* base, size_t pages, size_t page) {
+    munmap(base, (pages + 1) * page);
+}
+#endif
+
+void* guard_alloc(size_t size) {
+    size_t page  = get_memory_page_size();
+    size_t len   = guard_round(size);
+    size_t pages = (len + page - 1) / page;
+    char*  base  = NULL;
+    if(pages <= GUARD_POOL_PAGES) {
+        pthread_mutex_lock(&guard_lock);
+        guardFree* head = guard_pool[pages - 1];
+        if(head != NULL) {
+            guard_pool[pages - 1] = head->next;
+            base = (char*)head;
+        }
+        pthread_mutex_unlock(&guard_lock);
+    }
+    if(base == NULL) {
+        base = guard_map(pages, page);
+    }
+    return base == NULL ? NULL : base + pages * page - len;
+}
+
+void guard_free(void* ptr, size_t size) {
+    if(ptr == NULL) {
+        return;
+    }
+    size_t page  = get_memory_page_size();
+    size_t len   = guard_round(size);
+    size_t pages = (len + page - 1) / page;
+    char*  base  = (char*)ptr + len - pages * page;
+    if(pages > GUARD_POOL_PAGES) {
+        guard_unmap(base, pages, page);
+        return;
+    }
+    guardFree* node = (guardFree*)base;
+    pthread_mutex_lock(&guard_lock);
+    node->next            = guard_pool[pages - 1];
+    guard_pool[pages - 1] = node;
+    pthread_mutex_unlock(&guard_lock);
+}
+
+void guard_pool_clear() {
+    size_t page = get_memory_page_size();
+    pthread_mutex_lock(&guard_lock);
+    for(size_t i = 0; i < GUARD_POOL_PAGES; i++) {
+        while(guard_pool[i] != NULL) {
+            guardFree* next = guard_pool[i]->next;
+            guard_unmap(guard_pool[i], i + 1, page);
+            guard_pool[i] = next;
+        }
+    }
+    pthread_mutex_unlock(&guard_lock);
+}
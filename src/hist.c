@@ -0,0 +1,64 @@
+#include <string.h>
+
+#include "hist.h"
+
+static unsigned hist_log2(uint64_t v) {
+    #if defined(__GNUC__)
+    return 63 - (unsigned)__builtin_clzll(v);
+    #else
+    unsigned log = 0;
+    while(v >>= 1) {
+        log++;
+    }
+    return log;
+    #endif
+}
+
+static size_t hist_index(uint64_t v) {
+    if(v < 2 * HIST_HALF) {
+        return (size_t)v;
+    }
+    // The top HIST_SUB_BITS bits pick the bucket within it's power of two.
+    unsigned shift = hist_log2(v) - HIST_SUB_BITS + 1;
+    return HIST_HALF * (shift + 1) + (size_t)((v >> shift) - HIST_HALF);
+}
+
+// The middle of the values the bucket counts.
+static uint64_t hist_value(size_t index) {
+    if(index < 2 * HIST_HALF) {
+        return index;
+    }
+    unsigned shift = (unsigned)(index / HIST_HALF) - 1;
+    uint64_t top   = HIST_HALF + index % HIST_HALF;
+    return (top << shift) + (((uint64_t)1 << shift) >> 1);
+}
+
+void hist_init(latencyHist* h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_add(latencyHist* h, uint64_t value) {
+    h->buckets[hist_index(value)]++;
+    h->count++;
+    h->min = value < h->min ? value : h->min;
+    h->max = value > h->max ? value : h->max;
+}
+
+uint64_t hist_percentile(const latencyHist* h, double pct) {
+    if(h->count == 0) {
+        return 0;
+    }
+    double   want = pct * (double)h->count / 100;
+    uint64_t rank = (uint64_t)want;
+    uint64_t seen = 0;
+    rank += (double)rank < want || rank == 0;
+    for(size_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if(seen >= rank) {
+            uint64_t v = hist_value(i);
+            return v < h->min ? h->min : v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
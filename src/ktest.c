@@ -1,127 +1,631 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "ktest.h"
 #include "console.h"
 #include "timer.h"
+#include "pool.h"
+#include "bench.h"
+#include "perf-counters.h"
+#include "alloc-track.h"
+#include "sys-info.h"
+#include "filter.h"
+#include "reporter.h"
+#include "baseline.h"
+#include "shard.h"
+#include "order.h"
+#include "hist.h"
+#include "prop.h"
+#include "mem-cmp.h"
+#include "float-cmp.h"
+#include "guard-alloc.h"
+#include "golden.h"
 
-typedef struct test_case_s {
-    tcFn   test_func;
-    fixFn  setup;
-    tearFn tear;
-    char*  name;
-    char*  description;
-    size_t fix_sz;
-    int    status;
-    int    skip;
-} TestCase;
+#if CURRENT_OS == OS_LINUX || CURRENT_OS == OS_UNIX_LIKE
+    #include <errno.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #include <sys/wait.h>
+#endif
 
+// A fixture shared by several cases. It is built right before the first
+// of them runs and torn down once the last one is done.
+typedef struct suite_fix_s {
+    struct suite_fix_s* next;
+    fixFn               setup;
+    tearFn              tear;
+    size_t              size;
+    const char*         name;
+    void*               data;
+    size_t              users;
+    int                 built;
+    int                 failed;
+    pthread_mutex_t     lock;
+} SuiteFixture;
+
+typedef kTestCase TestCase;
+
+// Cases added while setting up live in added, once that is done tests
+// points at every case to run including the self registered ones. The
+// cases made from param cases live in instances, named from
+// instance_names.
 struct test_list_s {
-    size_t    count;
-    size_t    capacity;
-    TestCase* tests;
+    size_t        count;
+    TestCase**    tests;
+    size_t        added_count;
+    size_t        added_cap;
+    TestCase*     added;
+    SuiteFixture* suites;
+    nameIndex     index;
+    size_t        instance_count;
+    TestCase*     instances;
+    char*         instance_names;
 };
 
-int ktest_add_test_case(size_t* handle, kTestList* list, tcFn test_func, const char* name, const char* description) {
-    if(list->count >= list->capacity) {
-        size_t new_cap = list->capacity ? list->capacity * 2 : 16;
-        TestCase* new  = realloc(list->tests, sizeof(TestCase) * new_cap);
+// Filled by the constructors of self registering cases before main.
+static TestCase*  auto_head  = NULL;
+static TestCase** auto_tail  = &auto_head;
+static size_t     auto_count = 0;
+
+#define KTEST_MAX_REPORTERS 8
+// A case that hangs fails after this long instead of blocking the run for
+// good, --timeout 0 turns it off.
+#define KTEST_DEFAULT_TIMEOUT_MS (5 * 60 * 1000)
+
+typedef struct {
+    size_t      jobs;
+    int         fork;
+    int         perf;
+    int         allocs;
+    int         guard;
+    benchConfig bench;
+    reporter*   reporters;
+    size_t      reporter_count;
+    reporter*   baseline;
+    const char* save_baseline;
+    const char* compare_baseline;
+    double      regression_pct;
+    size_t      shard_index;
+    size_t      shard_count;
+    const char* shard_timings;
+    unsigned    timeout_ms;
+    const char*  history_path;
+    baselineFile history;
+    orderPolicy  order;
+    uint64_t     seed;
+    uint64_t     prop_seed;
+    size_t       prop_iters;
+    size_t       repeat;
+    int          until_fail;
+    int          update_golden;
+} kTestOptions;
+
+// The failures of the case running on a thread. They are passed on to the
+// reporters as they happen, unless the case is running in a child process
+// which sends them back along with it's result instead. Once a case that
+// timed out is abandoned anything else it records is dropped, and once a
+// repeated case failed the failures of later runs are only counted.
+typedef struct {
+    const TestCase*     tc;
+    outputInfo*         out;
+    const kTestOptions* opts;
+    caseFailure*        failures;
+    size_t              count;
+    size_t              cap;
+    int                 live;
+    int                 abandoned;
+    int                 quiet;
+} caseRecord;
+
+static _Thread_local caseRecord* current_case = NULL;
+static _Thread_local int         report_muted = 0;
+// Reporters writing to a file of their own are called under this.
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+// Cases that timed out and were given up on but are still running, kept
+// under the report lock. While there are any the tests can't be freed.
+static size_t          abandoned_running = 0;
+
+// Each worker writes a whole test case into it's own buffer, which is then
+// copied to the real output in one go so the banners never interleave.
+typedef struct {
+    outputInfo out;
+    char*      buf;
+    size_t     buf_sz;
+    int        failures;
+} workerOutput;
+
+typedef struct {
+    outputInfo*         out;
+    const kTestOptions* opts;
+    TestCase**          tests;
+    size_t*             cases;
+    workerOutput*       workers;
+    pthread_mutex_t     lock;
+} parallelRun;
+
+void ktest_register_case(kTestCase* tc) {
+    tc->next   = NULL;
+    *auto_tail = tc;
+    auto_tail  = &(tc->next);
+    auto_count++;
+}
+
+static int ktest_add_case(size_t* handle, kTestList* list, tcFn test_func, const char* name, const char* description, int bench) {
+    if(list->added_count >= list->added_cap) {
+        size_t new_cap = list->added_cap ? list->added_cap * 2 : 16;
+        TestCase* new  = realloc(list->added, sizeof(TestCase) * new_cap);
         if(new == NULL) {
             return KTEST_REALLOC_FAIL;
         }
-        list->tests    = new;
-        list->capacity = new_cap;
+        list->added     = new;
+        list->added_cap = new_cap;
     }
 
-    TestCase* cur    = &(list->tests[list->count]);
+    TestCase* cur    = &(list->added[list->added_count]);
+    cur->next        = NULL;
     cur->test_func   = test_func;
     cur->setup       = NULL;
     cur->tear        = NULL;
-    cur->name        = NULL;
-    cur->description = NULL;
+    cur->name        = name;
+    cur->description = description;
     cur->fix_sz      = 0;
+    cur->suite       = NULL;
     cur->status      = 0;
     cur->skip        = 0;
+    cur->bench       = bench;
+    cur->timeout_ms  = 0;
+    cur->params      = NULL;
+    cur->param_count = 0;
+    cur->param_size  = 0;
+    *handle = list->added_count;
+    list->added_count++;
+    return KTEST_SUCCESS;
+}
+
+int ktest_add_test_case(size_t* handle, kTestList* list, tcFn test_func, const char* name, const char* description) {
+    return ktest_add_case(handle, list, test_func, name, description, 0);
+}
 
-    size_t name_len  = strlen(name) + 1;
-    size_t desc_len  = strlen(description) + 1;
+int ktest_add_bench_case(size_t* handle, kTestList* list, tcFn bench_func, const char* name, const char* description) {
+    return ktest_add_case(handle, list, bench_func, name, description, 1);
+}
 
-    cur->name = malloc(name_len);
-    if(cur->name == NULL) {
-        return KTEST_MALLOC_FAIL;
+int ktest_add_param_case(size_t* handle, kTestList* list, tcFn test_func, const char* name, const char* description,
+                         const void* params, size_t param_count, size_t param_size) {
+    int err = ktest_add_case(handle, list, test_func, name, description, 0);
+    if(err != KTEST_SUCCESS) {
+        return err;
     }
+    list->added[*handle].params      = params;
+    list->added[*handle].param_count = param_count;
+    list->added[*handle].param_size  = param_size;
+    return KTEST_SUCCESS;
+}
 
-    cur->description = malloc(desc_len);
-    if(cur->description == NULL) {
-        free(cur->name);
-        cur->name = NULL;
-        return KTEST_MALLOC_FAIL;
+// Without the index finding a case by name falls back to a linear search.
+static void ktest_index_cases(kTestList* list) {
+    name_index_free(&(list->index));
+    if(name_index_init(&(list->index), list->count)) {
+        return;
+    }
+    for(size_t i = 0; i < list->count; i++) {
+        name_index_add(&(list->index), list->tests[i]->name, i);
+    }
+}
+
+static size_t ktest_digits(size_t n) {
+    size_t digits = 1;
+    while(n >= 10) {
+        n /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+// How many cases a param case becomes and how long their names are.
+static void ktest_count_params(const TestCase* tc, size_t* count, size_t* instances, size_t* name_bytes) {
+    if(!tc->param_size) {
+        (*count)++;
+        return;
+    }
+    *count      += tc->param_count;
+    *instances  += tc->param_count;
+    *name_bytes += tc->param_count * (strlen(tc->name) + ktest_digits(tc->param_count) + 2);
+}
+
+static void ktest_collect_case(kTestList* list, TestCase* tc, char** names) {
+    if(!tc->param_size) {
+        list->tests[list->count++] = tc;
+        return;
+    }
+    for(size_t i = 0; i < tc->param_count; i++) {
+        TestCase* inst    = list->instances + list->instance_count++;
+        int       written = sprintf(*names, "%s/%zu", tc->name, i);
+        *inst             = *tc;
+        inst->next        = NULL;
+        inst->name        = *names;
+        inst->params      = (const char*)tc->params + i * tc->param_size;
+        inst->param_count = 0;
+        inst->param_size  = 0;
+        *names += written + 1;
+        list->tests[list->count++] = inst;
     }
+}
 
-    memcpy(cur->name, name, name_len);
-    memcpy(cur->description, description, desc_len);
-    *handle = list->count;
-    list->count++;
+// Gathers the self registered cases and the added ones into the list that
+// is ran. Only the one array of pointers is allocated however many cases
+// there are, plus one array for all the cases made from params and one
+// block for their names.
+static int ktest_collect_cases(kTestList* list) {
+    size_t count      = 0;
+    size_t instances  = 0;
+    size_t name_bytes = 0;
+    for(TestCase* cur = auto_head; cur != NULL; cur = cur->next) {
+        ktest_count_params(cur, &count, &instances, &name_bytes);
+    }
+    for(size_t i = 0; i < list->added_count; i++) {
+        ktest_count_params(list->added + i, &count, &instances, &name_bytes);
+    }
+    if(count == 0) {
+        return KTEST_SUCCESS;
+    }
+    list->tests          = malloc(sizeof(TestCase*) * count);
+    list->instances      = malloc(sizeof(TestCase) * (instances + 1));
+    list->instance_names = malloc(name_bytes + 1);
+    if(list->tests == NULL || list->instances == NULL || list->instance_names == NULL) {
+        return KTEST_MALLOC_FAIL;
+    }
+    char* names = list->instance_names;
+    for(TestCase* cur = auto_head; cur != NULL; cur = cur->next) {
+        ktest_collect_case(list, cur, &names);
+    }
+    for(size_t i = 0; i < list->added_count; i++) {
+        ktest_collect_case(list, list->added + i, &names);
+    }
+    ktest_index_cases(list);
     return KTEST_SUCCESS;
 }
 
+static int ktest_has_bench(const kTestList* list) {
+    for(size_t i = 0; i < list->count; i++) {
+        if(list->tests[i]->bench && !list->tests[i]->skip) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 void ktest_skip_all(kTestList* list) {
     for(size_t i = 0; i < list->count; i++) {
-        list->tests[i].skip = 1;
+        list->tests[i]->skip = 1;
     }
 }
 
 int ktest_set_skip(kTestList* list, const char* name, int skip) {
+    size_t id = 0;
+    if(name_index_find(&(list->index), name, &id)) {
+        list->tests[id]->skip = skip;
+        return 1;
+    }
+    if(list->index.slots != NULL) {
+        return 0;
+    }
     for(size_t i = 0; i < list->count; i++) {
-        if(strcmp(name, list->tests[i].name) == 0) {
-            list->tests[i].skip = skip;
+        if(strcmp(name, list->tests[i]->name) == 0) {
+            list->tests[i]->skip = skip;
             return 1;
         }
     }
     return 0;
 }
 
-static void ktest_free_tests(kTestList* list) {
-    for(size_t i = 0; i < list->count; i++) {
-        free(list->tests[i].name);
-        free(list->tests[i].description);
+static void ktest_free_suites(kTestList* list) {
+    SuiteFixture* cur = list->suites;
+    while(cur != NULL) {
+        SuiteFixture* next = cur->next;
+        pthread_mutex_destroy(&(cur->lock));
+        free(cur->data);
+        free(cur);
+        cur = next;
     }
+    list->suites = NULL;
+}
+
+static void ktest_free_tests(kTestList* list) {
     free(list->tests);
+    free(list->added);
+    free(list->instances);
+    free(list->instance_names);
+    name_index_free(&(list->index));
+    ktest_free_suites(list);
 }
 
 int ktest_set_fixture(size_t handle, kTestList* list, fixFn setup, tearFn teardown, size_t fixture_size) {
-    if(handle >= list->count) {
+    if(handle >= list->added_count) {
+        return KTEST_BAD_HANDLE;
+    }
+    if(list->added[handle].suite != NULL || list->added[handle].param_size) {
+        return KTEST_FIX_CONFLICT;
+    }
+    list->added[handle].setup  = setup;
+    list->added[handle].tear   = teardown;
+    list->added[handle].fix_sz = fixture_size;
+    return KTEST_SUCCESS;
+}
+
+int ktest_set_timeout(size_t handle, kTestList* list, unsigned timeout_ms) {
+    if(handle >= list->added_count) {
+        return KTEST_BAD_HANDLE;
+    }
+    list->added[handle].timeout_ms = timeout_ms;
+    return KTEST_SUCCESS;
+}
+
+// Every case setting the same suite fixture shares the one instance of it.
+int ktest_set_suite_fixture(size_t handle, kTestList* list, fixFn setup, tearFn teardown, size_t fixture_size, const char* name) {
+    if(handle >= list->added_count) {
         return KTEST_BAD_HANDLE;
     }
-    list->tests[handle].setup  = setup;
-    list->tests[handle].tear   = teardown;
-    list->tests[handle].fix_sz = fixture_size;
+    if(list->added[handle].fix_sz || list->added[handle].param_size) {
+        return KTEST_FIX_CONFLICT;
+    }
+    SuiteFixture* cur = list->suites;
+    while(cur != NULL && cur->setup != setup) {
+        cur = cur->next;
+    }
+    if(cur == NULL) {
+        cur = calloc(1, sizeof(SuiteFixture));
+        if(cur == NULL) {
+            return KTEST_MALLOC_FAIL;
+        }
+        if(pthread_mutex_init(&(cur->lock), NULL) != 0) {
+            free(cur);
+            return KTEST_UNKNOWN_ERR;
+        }
+        cur->setup   = setup;
+        cur->tear    = teardown;
+        cur->size    = fixture_size;
+        cur->name    = name;
+        cur->next    = list->suites;
+        list->suites = cur;
+    }
+    list->added[handle].suite = cur;
     return KTEST_SUCCESS;
 }
 
 void ktest_free_test_list(kTestList* list) {
+    ktest_free_tests(list);
+    list->count       = 0;
+    list->tests       = NULL;
+    list->added_count    = 0;
+    list->added_cap      = 0;
+    list->added          = NULL;
+    list->instance_count = 0;
+    list->instances      = NULL;
+    list->instance_names = NULL;
+}
+
+// Counts how many of the cases about to run use each suite fixture so the
+// last one knows to tear it down.
+static void ktest_suite_count_users(const kTestList* list) {
+    for(SuiteFixture* cur = list->suites; cur != NULL; cur = cur->next) {
+        cur->users = 0;
+    }
     for(size_t i = 0; i < list->count; i++) {
-        TestCase* cur = list->tests + i;
-        free(cur->name);
-        cur->name = NULL;
-        free(cur->description);
-        cur->description = NULL;
+        if(list->tests[i]->suite != NULL && !list->tests[i]->skip) {
+            list->tests[i]->suite->users++;
+        }
     }
-    free(list->tests);
-    list->count    = 0;
-    list->capacity = 0;
-    list->tests    = NULL;
 }
 
-int ktest_run_test_case(outputInfo* out, TestCase* tc) {
-    char        buffer[14]  = { 0 };
-    timerData   t           = { 0 };
-    void*       fix         = NULL;
-    kTestStatus stat        = {
+// Builds the suite fixture if this is the first case using it. Anyone else
+// wanting it waits until it is done. Returns non-zero if it could not be
+// built, in which case none of it's cases are ran.
+static int ktest_suite_acquire(outputInfo* out, SuiteFixture* sf) {
+    if(sf == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&(sf->lock));
+    if(!sf->built) {
+        kTestStatus stat = {
+            .output = out->output
+        };
+        sf->built = 1;
+        fprintf(
+            out->output,
+            "[  %sSuite Fix%s : %s%-13s%s]\n",
+            out->fg.l_yellow,
+            out->reset,
+            out->fg.l_cyan,
+            sf->name,
+            out->reset
+        );
+        sf->data = calloc(1, sf->size);
+        if(sf->data == NULL) {
+            sf->failed = 1;
+        } else if(sf->setup != NULL) {
+            sf->setup(&stat, sf->data);
+            sf->failed = stat.result;
+        }
+    }
+    int failed = sf->failed;
+    pthread_mutex_unlock(&(sf->lock));
+    return failed;
+}
+
+static void ktest_suite_teardown(outputInfo* out, SuiteFixture* sf) {
+    kTestStatus stat = {
         .output = out->output
     };
+    // Only what setup finished is torn down.
+    if(sf->data != NULL && sf->tear != NULL && !sf->failed) {
+        sf->tear(&stat, sf->data);
+    }
+    free(sf->data);
+    sf->data = NULL;
+}
+
+static void ktest_suite_release(outputInfo* out, SuiteFixture* sf) {
+    if(sf == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&(sf->lock));
+    if(sf->users > 0 && --sf->users == 0) {
+        ktest_suite_teardown(out, sf);
+    }
+    pthread_mutex_unlock(&(sf->lock));
+}
+
+static caseReport ktest_case_report(const caseRecord* rec, const caseResult* res) {
+    caseReport c = {
+        .name          = rec->tc->name,
+        .description   = rec->tc->description,
+        .res           = res,
+        .failures      = rec->failures,
+        .failure_count = rec->count
+    };
+    return c;
+}
+
+static void ktest_report_assert_fail_locked(const caseRecord* rec, const caseFailure* f) {
+    caseReport c = ktest_case_report(rec, NULL);
+    for(size_t i = 0; i < rec->opts->reporter_count; i++) {
+        reporter* r = rec->opts->reporters + i;
+        if(r->ops->assert_fail != NULL) {
+            r->ops->assert_fail(r, rec->out, &c, f);
+        }
+    }
+}
+
+static void ktest_report_assert_fail(const caseRecord* rec, const caseFailure* f) {
+    pthread_mutex_lock(&report_lock);
+    ktest_report_assert_fail_locked(rec, f);
+    pthread_mutex_unlock(&report_lock);
+}
+
+// Held under the report lock so a case that timed out can be given up on
+// while it is still recording.
+static void ktest_record_vadd(caseRecord* rec, const char* file, unsigned line, const char* fmt, va_list args) {
+    pthread_mutex_lock(&report_lock);
+    if(rec->abandoned || rec->quiet) {
+        pthread_mutex_unlock(&report_lock);
+        return;
+    }
+    if(rec->count >= rec->cap) {
+        // Growing the record is not something the test allocated.
+        size_t       new_cap = rec->cap ? rec->cap * 2 : 4;
+        int          paused  = alloc_track_pause();
+        caseFailure* new     = realloc(rec->failures, sizeof(caseFailure) * new_cap);
+        alloc_track_resume(paused);
+        if(new == NULL) {
+            pthread_mutex_unlock(&report_lock);
+            return;
+        }
+        rec->failures = new;
+        rec->cap      = new_cap;
+    }
+    caseFailure* f = rec->failures + rec->count;
+    f->file = file;
+    f->line = line;
+    vsnprintf(f->msg, sizeof(f->msg), fmt, args);
+    rec->count++;
+    if(rec->live) {
+        ktest_report_assert_fail_locked(rec, f);
+    }
+    pthread_mutex_unlock(&report_lock);
+}
+
+static void ktest_record_add(caseRecord* rec, const char* file, unsigned line, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    ktest_record_vadd(rec, file, line, fmt, args);
+    va_end(args);
+}
+
+void ktest_report_mute(int mute) {
+    report_muted = mute;
+}
+
+void* ktest_report_context() {
+    return current_case;
+}
+
+void ktest_report_adopt(void* ctx) {
+    current_case = ctx;
+}
+
+void ktest_report_failure(const char* file, unsigned line, const char* fmt, ...) {
+    va_list args;
+    if(current_case == NULL || report_muted) {
+        return;
+    }
+    va_start(args, fmt);
+    ktest_record_vadd(current_case, file, line, fmt, args);
+    va_end(args);
+}
+
+static void ktest_report_suite_start(outputInfo* out, const kTestOptions* opts, const char* name, size_t count) {
+    for(size_t i = 0; i < opts->reporter_count; i++) {
+        reporter* r = opts->reporters + i;
+        if(r->ops->suite_start != NULL) {
+            r->ops->suite_start(r, out, name, count);
+        }
+    }
+}
+
+static void ktest_report_case_start(const caseRecord* rec) {
+    caseReport c = ktest_case_report(rec, NULL);
+    pthread_mutex_lock(&report_lock);
+    for(size_t i = 0; i < rec->opts->reporter_count; i++) {
+        reporter* r = rec->opts->reporters + i;
+        if(r->ops->case_start != NULL) {
+            r->ops->case_start(r, rec->out, &c);
+        }
+    }
+    pthread_mutex_unlock(&report_lock);
+}
+
+static void ktest_report_case_end(const caseRecord* rec, const caseResult* res) {
+    caseReport c = ktest_case_report(rec, res);
+    pthread_mutex_lock(&report_lock);
+    for(size_t i = 0; i < rec->opts->reporter_count; i++) {
+        reporter* r = rec->opts->reporters + i;
+        if(r->ops->case_end != NULL) {
+            r->ops->case_end(r, rec->out, &c);
+        }
+    }
+    pthread_mutex_unlock(&report_lock);
+}
+
+static void ktest_report_case_skip(outputInfo* out, const kTestOptions* opts, const TestCase* tc) {
+    caseRecord rec = { .tc = tc, .out = out, .opts = opts };
+    caseReport c   = ktest_case_report(&rec, NULL);
+    for(size_t i = 0; i < opts->reporter_count; i++) {
+        reporter* r = opts->reporters + i;
+        if(r->ops->case_skip != NULL) {
+            r->ops->case_skip(r, out, &c);
+        }
+    }
+}
+
+static void ktest_report_summary(outputInfo* out, const kTestOptions* opts, const runSummary* sum) {
+    for(size_t i = 0; i < opts->reporter_count; i++) {
+        reporter* r = opts->reporters + i;
+        if(r->ops->summary != NULL) {
+            r->ops->summary(r, out, sum);
+        }
+    }
+}
+
+static void ktest_print_case_start(outputInfo* out, const char* name) {
     fprintf(out->output, "+===========================+\n");
     fprintf(
         out->output,
@@ -129,181 +633,1538 @@ int ktest_run_test_case(outputInfo* out, TestCase* tc) {
         out->fg.l_blue,
         out->reset,
         out->fg.l_cyan,
-        tc->name,
+        name,
         out->reset
     );
+}
+
+// Anything the setup, body or teardown allocated should be gone once the
+// teardown is done.
+static int ktest_case_leaked(const caseResult* res) {
+    return res->leaks.live > 0 && res->leaks.allocs > res->leaks.frees;
+}
+
+// Runs the fixture setup, the test and the teardown.
+static void ktest_exec_case(outputInfo* out, TestCase* tc, const kTestOptions* opts, caseResult* res) {
+    perfGroup   perf = { 0 };
+    void*       fix  = NULL;
+    kTestStatus stat = {
+        .output = current_case != NULL && current_case->quiet ? NULL : out->output
+    };
 
-    if(tc->fix_sz) {
-        fix = malloc(tc->fix_sz);
+    if(tc->suite != NULL) {
+        fix = tc->suite->data;
+    } else if(tc->fix_sz) {
+        fix = opts->guard ? guard_alloc(tc->fix_sz) : malloc(tc->fix_sz);
         if(fix == NULL) {
             fprintf(out->output, "%s+===========================+\n", out->fg.l_red);
             fprintf(out->output, "| %sALLOCATING FIXTURE FAILED%s |\n", out->bold, out->normal);
             fprintf(out->output, "+===========================+%s\n", out->reset);
-            return 1;
+            ktest_report_failure(NULL, 0, "allocating fixture failed");
+            res->result = 1;
+            return;
         }
         memset(fix, 0, tc->fix_sz);
+    } else if(tc->params != NULL) {
+        fix = (void*)tc->params;
     }
 
-    timer_start(&t);
+    timer_start(&(res->time));
+    alloc_track_begin();
     if(tc->setup != NULL) {
         tc->setup(&stat, fix);
     }
 
-    tc->test_func(&stat, fix);
+    // Only the body is counted, not the fixture.
+    int counting = opts->perf && perf_group_open(&perf) == 0;
+    if(counting) {
+        perf_group_start(&perf);
+    }
+    alloc_track_body_begin();
+    if(tc->bench) {
+        // Only the loop over the body is timed, not the fixture.
+        if(!stat.result) {
+            bench_run(&(opts->bench), &stat, tc->test_func, fix, &(res->bench));
+        }
+    } else {
+        tc->test_func(&stat, fix);
+    }
+    alloc_track_body_end(&(res->allocs));
+    if(counting) {
+        perf_group_stop(&perf, &(res->perf));
+        perf_group_close(&perf);
+    }
 
     if(tc->tear  != NULL) {
         tc->tear(&stat, fix);
     }
-    timer_stop(&t);
-    free(fix);
-    timer_get_str(&t, buffer);
+    alloc_track_end(&(res->leaks));
+    timer_stop(&(res->time));
+    if(tc->suite == NULL && tc->params == NULL) {
+        if(opts->guard) {
+            guard_free(fix, tc->fix_sz);
+        } else {
+            free(fix);
+        }
+    }
 
-    if(stat.result) {
-        fprintf(out->output, " Expects Ran : %u\n", stat.expects);
-        fprintf(out->output, " Asserts Ran : %u\n", stat.asserts);
+    if(opts->allocs && ktest_case_leaked(res)) {
+        ktest_report_failure(
+            NULL,
+            0,
+            "leaked %"PRId64" bytes in %"PRIu64" blocks",
+            res->leaks.live,
+            res->leaks.allocs - res->leaks.frees
+        );
+        stat.result = 1;
     }
+    res->result  = stat.result;
+    res->asserts = stat.asserts;
+    res->expects = stat.expects;
+}
+
+static void ktest_print_bench_line(outputInfo* out, const char* label, double ns) {
+    char buffer[14] = { 0 };
+    bench_format_ns(ns, buffer);
     fprintf(
         out->output,
-        "[     %sResult%s : %s%s%-13s%s]\n",
-        out->fg.l_cyan,
+        "[%s%11s%s : %s%-13s%s]\n",
+        out->fg.l_yellow,
+        label,
         out->reset,
-        out->bold,
-        stat.result ? out->fg.l_red : out->fg.l_green,
-        stat.result ? "Failed" : "Passed",
+        out->fg.l_magenta,
+        buffer,
         out->reset
     );
+}
+
+static void ktest_print_mitigation(outputInfo* out, const char* label, const char* value) {
     fprintf(
         out->output,
-        "[       %sTime%s : %s%-13s%s]\n",
+        "[%s%11s%s : %s%-13s%s]\n",
         out->fg.l_yellow,
+        label,
         out->reset,
-        out->fg.l_magenta,
-        buffer,
+        out->fg.l_cyan,
+        value,
         out->reset
     );
-    return stat.result;
 }
 
-int ktest_run_tests(outputInfo* out, const char* name, const kTestList* list) {
-    fprintf(out->output, "+===========================+\n");
+// Only what was actually done is listed, asking for it isn't enough.
+static void ktest_print_mitigations(outputInfo* out, const benchStats* stats, const benchConfig* cfg) {
+    char buffer[32] = { 0 };
+    if(stats->applied & BENCH_PINNED) {
+        snprintf(buffer, sizeof(buffer), "cpu %d", stats->cpu);
+        ktest_print_mitigation(out, "Pinned", buffer);
+    }
+    if(stats->applied & BENCH_PRIORITY) {
+        snprintf(buffer, sizeof(buffer), "+%d levels", stats->priority);
+        ktest_print_mitigation(out, "Priority", buffer);
+    }
+    if(stats->applied & BENCH_WARMUP) {
+        snprintf(buffer, sizeof(buffer), "%zu batches", cfg->warmup);
+        ktest_print_mitigation(out, "Warmup", buffer);
+    }
+    if(stats->applied & BENCH_COLD) {
+        ktest_print_mitigation(out, "Caches", "cold");
+    }
+    if(stats->applied & BENCH_MAD) {
+        snprintf(buffer, sizeof(buffer), "%zu dropped", stats->outliers);
+        ktest_print_mitigation(out, "Outliers", buffer);
+    }
+}
+
+static void ktest_print_bench(outputInfo* out, const benchStats* stats, const benchConfig* cfg) {
+    char buffer[32] = { 0 };
+    snprintf(buffer, sizeof(buffer), "%zux%"PRIu64, stats->samples, stats->iters);
     fprintf(
         out->output,
-        "| %sRunning%s: %s%-17s%s|\n",
-        out->fg.l_blue,
+        "[    %sSamples%s : %s%-13s%s]\n",
+        out->fg.l_yellow,
         out->reset,
-        out->fg.l_cyan,
-        name,
+        out->fg.l_magenta,
+        buffer,
         out->reset
     );
+    ktest_print_bench_line(out, "Min/op",    stats->min);
+    ktest_print_bench_line(out, "Median/op", stats->median);
+    ktest_print_bench_line(out, "Mean/op",   stats->mean);
+    ktest_print_bench_line(out, "Stddev/op", stats->stddev);
+    ktest_print_bench_line(out, "P99/op",    stats->p99);
+    snprintf(buffer, sizeof(buffer), "%.1f", stats->cycles);
     fprintf(
         out->output,
-        "| %sTest Cases%s: %s%s%-14zu%s|\n",
-        out->fg.l_blue,
+        "[  %sCycles/op%s : %s%-13s%s]\n",
+        out->fg.l_yellow,
         out->reset,
-        out->bold,
         out->fg.l_magenta,
-        list->count,
+        buffer,
         out->reset
     );
-    int failures = 0;
-    int passed   = list->count;
-    int skipped  = 0;
-    timerData  t = { 0 };
+    ktest_print_mitigations(out, stats, cfg);
+}
 
-    timer_start(&t);
-    for(size_t i = 0; i < list->count; i++) {
-        if(list->tests[i].skip) {
-            fprintf(out->output, "+===========================+\n");
-            fprintf(
-                out->output,
-                "[   %s%sSkipping%s : %s%-13s%s]\n",
-                out->bold,
-                out->fg.l_yellow,
-                out->reset,
-                out->fg.l_cyan,
-                list->tests[i].name,
-                out->reset
-            );
-            skipped++;
-            continue;
-        }
-        failures += ktest_run_test_case(out, &(list->tests[i]));
+static void ktest_print_perf_line(outputInfo* out, const char* label, const perfCounts* perf, int counter) {
+    char buffer[24] = "n/a";
+    if(perf->have[counter]) {
+        snprintf(buffer, sizeof(buffer), "%"PRIu64, perf->counts[counter]);
     }
-    timer_stop(&t);
+    fprintf(
+        out->output,
+        "[%s%11s%s : %s%-13s%s]\n",
+        out->fg.l_yellow,
+        label,
+        out->reset,
+        out->fg.l_magenta,
+        buffer,
+        out->reset
+    );
+}
 
-    passed -= failures;
-    passed -= skipped;
-    fprintf(out->output, "+===========================+\n");
+static void ktest_print_perf(outputInfo* out, const perfCounts* perf) {
+    char buffer[24] = "n/a";
+    ktest_print_perf_line(out, "Cycles", perf, PERF_CYCLES);
+    ktest_print_perf_line(out, "Instrs", perf, PERF_INSTRUCTIONS);
+    if(perf->have[PERF_CYCLES] && perf->have[PERF_INSTRUCTIONS] && perf->counts[PERF_CYCLES]) {
+        double ipc = (double)perf->counts[PERF_INSTRUCTIONS] / perf->counts[PERF_CYCLES];
+        snprintf(buffer, sizeof(buffer), "%.2f", ipc);
+    }
     fprintf(
         out->output,
-        "Summary for %s'%s'%s\n",
-        out->fg.l_cyan,
-        name,
+        "[        %sIPC%s : %s%-13s%s]\n",
+        out->fg.l_yellow,
+        out->reset,
+        out->fg.l_magenta,
+        buffer,
         out->reset
     );
+    ktest_print_perf_line(out, "L1D Misses",  perf, PERF_L1D_MISSES);
+    ktest_print_perf_line(out, "LLC Misses",  perf, PERF_LLC_MISSES);
+    ktest_print_perf_line(out, "Branch Miss", perf, PERF_BRANCH_MISSES);
+}
+
+static void ktest_print_alloc_line(outputInfo* out, const char* label, uint64_t val) {
     fprintf(
         out->output,
-        "Test Cases %sPassed%s : %s%s%d%s\n",
-        passed > 0 ? out->fg.l_green : "",
+        "[%s%11s%s : %s%-13"PRIu64"%s]\n",
+        out->fg.l_yellow,
+        label,
         out->reset,
-        passed > 0 ? out->bold : "",
-        passed > 0 ? out->fg.l_magenta : "",
-        passed,
+        out->fg.l_magenta,
+        val,
         out->reset
     );
+}
+
+static void ktest_print_allocs(outputInfo* out, const allocStats* allocs) {
+    ktest_print_alloc_line(out, "Allocs", allocs->allocs);
+    ktest_print_alloc_line(out, "Bytes", allocs->bytes);
+    ktest_print_alloc_line(out, "Peak Bytes", allocs->peak > 0 ? allocs->peak : 0);
+}
+
+// Replaces the time of a single run with how the times of every run were
+// spread, and how many of them failed.
+static void ktest_print_repeat(outputInfo* out, const repeatStats* rep) {
+    char buffer[32] = { 0 };
+    snprintf(buffer, sizeof(buffer), "%"PRIu64, rep->runs);
     fprintf(
         out->output,
-        "Test Cases %sFailed%s : %s%s%d%s\n",
-        failures ? out->fg.l_red : "",
+        "[       %sRuns%s : %s%-13s%s]\n",
+        out->fg.l_yellow,
         out->reset,
-        failures > 0 ? out->bold : "",
-        failures > 0 ? out->fg.l_magenta : "",
-        failures,
+        out->fg.l_magenta,
+        buffer,
         out->reset
     );
+    snprintf(buffer, sizeof(buffer), "%.2f%%", (double)rep->failed * 100 / (double)rep->runs);
     fprintf(
         out->output,
-        "Test Cases %sSkipped%s : %s%s%d%s\n",
-        skipped ? out->fg.l_yellow : "",
+        "[ %sFlake Rate%s : %s%-13s%s]\n",
+        out->fg.l_yellow,
         out->reset,
-        skipped > 0 ? out->bold : "",
-        skipped > 0 ? out->fg.l_magenta : "",
-        skipped,
+        rep->failed ? out->fg.l_red : out->fg.l_magenta,
+        buffer,
         out->reset
     );
+    ktest_print_bench_line(out, "Min",    (double)rep->min_ns);
+    ktest_print_bench_line(out, "Median", (double)rep->median_ns);
+    ktest_print_bench_line(out, "P99",    (double)rep->p99_ns);
+    ktest_print_bench_line(out, "Max",    (double)rep->max_ns);
+}
+
+static void ktest_print_case_result(outputInfo* out, const caseResult* res, const kTestOptions* opts) {
+    char buffer[14] = { 0 };
+    timer_get_str(&(res->time), buffer);
+
+    if(opts->allocs && ktest_case_leaked(res)) {
+        fprintf(
+            out->output,
+            "      %sLeaked%s : %"PRId64" bytes in %"PRIu64" blocks\n",
+            out->fg.l_red,
+            out->reset,
+            res->leaks.live,
+            res->leaks.allocs - res->leaks.frees
+        );
+    }
+
+    if(res->result) {
+        fprintf(out->output, " Expects Ran : %u\n", res->expects);
+        fprintf(out->output, " Asserts Ran : %u\n", res->asserts);
+    }
+    fprintf(
+        out->output,
+        "[     %sResult%s : %s%s%-13s%s]\n",
+        out->fg.l_cyan,
+        out->reset,
+        out->bold,
+        res->result ? out->fg.l_red : out->fg.l_green,
+        res->result ? "Failed" : "Passed",
+        out->reset
+    );
+    if(res->repeat.runs) {
+        ktest_print_repeat(out, &(res->repeat));
+    } else {
+        fprintf(
+            out->output,
+            "[       %sTime%s : %s%-13s%s]\n",
+            out->fg.l_yellow,
+            out->reset,
+            out->fg.l_magenta,
+            buffer,
+            out->reset
+        );
+    }
+    if(res->perf.valid) {
+        ktest_print_perf(out, &(res->perf));
+    }
+    if(opts->allocs) {
+        ktest_print_allocs(out, &(res->allocs));
+    }
+    if(res->bench.samples) {
+        ktest_print_bench(out, &(res->bench), &(opts->bench));
+    }
+}
+
+#if CURRENT_OS == OS_WINDOWS
+static int worker_output_open(workerOutput* w, const outputInfo* out) {
+    w->out        = *out;
+    w->out.output = tmpfile();
+    return w->out.output == NULL;
+}
+
+static void worker_output_flush(workerOutput* w, FILE* dst) {
+    char   chunk[4096];
+    fflush(w->out.output);
+    long   len = ftell(w->out.output);
+    rewind(w->out.output);
+    while(len > 0) {
+        size_t amt = fread(chunk, 1, len < (long)sizeof(chunk) ? (size_t)len : sizeof(chunk), w->out.output);
+        if(amt == 0) {
+            break;
+        }
+        fwrite(chunk, 1, amt, dst);
+        len -= amt;
+    }
+    rewind(w->out.output);
+}
+#else
+static int worker_output_open(workerOutput* w, const outputInfo* out) {
+    w->out        = *out;
+    w->out.output = open_memstream(&(w->buf), &(w->buf_sz));
+    return w->out.output == NULL;
+}
+
+static void worker_output_flush(workerOutput* w, FILE* dst) {
+    fflush(w->out.output);
+    fwrite(w->buf, 1, w->buf_sz, dst);
+    rewind(w->out.output);
+}
+#endif
+
+static void worker_output_close(workerOutput* w) {
+    if(w->out.output != NULL) {
+        fclose(w->out.output);
+    }
+    free(w->buf);
+}
+
+static unsigned ktest_case_timeout(const TestCase* tc, const kTestOptions* opts) {
+    return tc->timeout_ms ? tc->timeout_ms : opts->timeout_ms;
+}
+
+// Cases with a timeout run on a thread kept for the worker running them,
+// so whoever handed the case over can stop waiting on it. The thread
+// writes into a buffer of it's own and is only replaced once a case on it
+// times out, it then frees all of this itself once that case does finish.
+typedef struct case_runner_s caseRunner;
+
+struct case_runner_s {
+    pthread_t       thread;
+    TestCase*       tc;
+    caseRecord      rec;
+    caseResult      res;
+    workerOutput    w;
+    int             pending;
+    int             done;
+    int             abandoned;
+    int             stop;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    caseRunner*     next;
+};
+
+static _Thread_local caseRunner* case_runner = NULL;
+// Every runner that is not abandoned, so they can be stopped at the end.
+static caseRunner*     runners      = NULL;
+static pthread_mutex_t runners_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void ktest_runner_free(caseRunner* r) {
+    worker_output_close(&(r->w));
+    pthread_cond_destroy(&(r->cond));
+    pthread_mutex_destroy(&(r->lock));
+    free(r->rec.failures);
+    free(r);
+}
+
+static void ktest_runner_unlist(caseRunner* r) {
+    pthread_mutex_lock(&runners_lock);
+    for(caseRunner** cur = &runners; *cur != NULL; cur = &((*cur)->next)) {
+        if(*cur == r) {
+            *cur = r->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&runners_lock);
+}
+
+static void* ktest_runner_thread(void* arg) {
+    caseRunner* r = arg;
+    for(;;) {
+        pthread_mutex_lock(&(r->lock));
+        while(!r->pending && !r->stop) {
+            pthread_cond_wait(&(r->cond), &(r->lock));
+        }
+        if(!r->pending) {
+            pthread_mutex_unlock(&(r->lock));
+            return NULL;
+        }
+        r->pending = 0;
+        pthread_mutex_unlock(&(r->lock));
+
+        current_case = &(r->rec);
+        ktest_exec_case(r->rec.out, r->tc, r->rec.opts, &(r->res));
+        current_case = NULL;
+
+        pthread_mutex_lock(&(r->lock));
+        int abandoned = r->abandoned;
+        r->done = 1;
+        pthread_cond_signal(&(r->cond));
+        pthread_mutex_unlock(&(r->lock));
+        if(abandoned) {
+            ktest_runner_free(r);
+            pthread_mutex_lock(&report_lock);
+            abandoned_running--;
+            pthread_mutex_unlock(&report_lock);
+            return NULL;
+        }
+    }
+}
+
+static caseRunner* ktest_runner_new(const outputInfo* out) {
+    caseRunner* r = calloc(1, sizeof(caseRunner));
+    if(r == NULL) {
+        return NULL;
+    }
+    if(worker_output_open(&(r->w), out)) {
+        free(r);
+        return NULL;
+    }
+    if(pthread_mutex_init(&(r->lock), NULL) != 0) {
+        worker_output_close(&(r->w));
+        free(r);
+        return NULL;
+    }
+    if(pthread_cond_init(&(r->cond), NULL) != 0) {
+        pthread_mutex_destroy(&(r->lock));
+        worker_output_close(&(r->w));
+        free(r);
+        return NULL;
+    }
+    if(pthread_create(&(r->thread), NULL, ktest_runner_thread, r) != 0) {
+        ktest_runner_free(r);
+        return NULL;
+    }
+    pthread_mutex_lock(&runners_lock);
+    r->next = runners;
+    runners = r;
+    pthread_mutex_unlock(&runners_lock);
+    return r;
+}
+
+// Stops the runners left once every case is done.
+static void ktest_runners_stop() {
+    pthread_mutex_lock(&runners_lock);
+    caseRunner* r = runners;
+    runners = NULL;
+    pthread_mutex_unlock(&runners_lock);
+    while(r != NULL) {
+        caseRunner* next = r->next;
+        pthread_mutex_lock(&(r->lock));
+        r->stop = 1;
+        pthread_cond_signal(&(r->cond));
+        pthread_mutex_unlock(&(r->lock));
+        pthread_join(r->thread, NULL);
+        ktest_runner_free(r);
+        r = next;
+    }
+    case_runner = NULL;
+}
+
+// Takes over what the case recorded so far. Past this point the thread
+// can no longer add to it.
+static void ktest_runner_abandon(caseRunner* r, caseRecord* rec, outputInfo* out) {
+    pthread_mutex_lock(&report_lock);
+    r->rec.abandoned = 1;
+    abandoned_running++;
+    if(r->rec.count > 0) {
+        rec->failures = malloc(sizeof(caseFailure) * r->rec.count);
+        if(rec->failures != NULL) {
+            memcpy(rec->failures, r->rec.failures, sizeof(caseFailure) * r->rec.count);
+            rec->count = r->rec.count;
+            rec->cap   = r->rec.count;
+        }
+    }
+    pthread_mutex_unlock(&report_lock);
+
+    // Whatever it printed before it hung is usually the best clue as to
+    // why it did.
+    #if CURRENT_OS == OS_LINUX || CURRENT_OS == OS_UNIX_LIKE
+    flockfile(r->w.out.output);
+    worker_output_flush(&(r->w), out->output);
+    funlockfile(r->w.out.output);
+    #else
+    worker_output_flush(&(r->w), out->output);
+    #endif
+}
+
+// Runs the case on this thread's runner and waits up to timeout_ms for it.
+// Returns 1 if it timed out, in which case the runner is left behind, or
+// -1 if there is no runner and the case never ran.
+static int ktest_run_guarded(outputInfo* out, TestCase* tc, caseRecord* rec, caseResult* res, unsigned timeout_ms) {
+    timerData t = { 0 };
+    if(case_runner == NULL) {
+        case_runner = ktest_runner_new(out);
+    }
+    caseRunner* r = case_runner;
+    if(r == NULL) {
+        return -1;
+    }
+
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_sec  += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    // The runner keeps the colours and such of the output it was made for,
+    // only where it writes to is it's own.
+    FILE* own = r->w.out.output;
+    r->w.out        = *out;
+    r->w.out.output = own;
+    r->tc           = tc;
+    r->rec          = *rec;
+    r->rec.out      = &(r->w.out);
+    memset(&(r->res), 0, sizeof(caseResult));
+
+    timer_start(&t);
+    pthread_mutex_lock(&(r->lock));
+    r->done    = 0;
+    r->pending = 1;
+    pthread_cond_signal(&(r->cond));
+    int err = 0;
+    while(!r->done && err == 0) {
+        err = pthread_cond_timedwait(&(r->cond), &(r->lock), &deadline);
+    }
+    timer_stop(&t);
+    // Taken over while still holding the lock, the thread frees all of it
+    // as soon as it sees it was abandoned.
+    int abandoned = !r->done;
+    r->abandoned  = abandoned;
+    if(abandoned) {
+        ktest_runner_unlist(r);
+        ktest_runner_abandon(r, rec, out);
+    }
+    pthread_mutex_unlock(&(r->lock));
+
+    if(abandoned) {
+        pthread_detach(r->thread);
+        case_runner = NULL;
+        res->time   = t;
+        res->result = 1;
+        return 1;
+    }
+    worker_output_flush(&(r->w), out->output);
+    *res          = r->res;
+    rec->failures = r->rec.failures;
+    rec->count    = r->rec.count;
+    rec->cap      = r->rec.cap;
+    r->rec.failures = NULL;
+    return 0;
+}
+
+// Prints and records that the case was stopped after running for ns.
+static void ktest_timed_out(caseRecord* rec, uint64_t ns, unsigned timeout_ms) {
+    char buffer[14] = { 0 };
+    timer_format_ns_u64(ns, buffer);
+    fprintf(
+        rec->out->output,
+        "   %sTimed Out%s : after %s, the limit is %ums\n",
+        rec->out->fg.l_red,
+        rec->out->reset,
+        buffer,
+        timeout_ms
+    );
+    ktest_record_add(rec, NULL, 0, "timed out after %s, the limit is %ums", buffer, timeout_ms);
+}
+
+static int ktest_repeating(const TestCase* tc, const kTestOptions* opts) {
+    return !tc->bench && opts->repeat != 1;
+}
+
+static void ktest_repeat_stats(caseResult* res, const latencyHist* hist, uint64_t failed) {
+    res->repeat.runs      = hist->count;
+    res->repeat.failed    = failed;
+    res->repeat.min_ns    = hist->min;
+    res->repeat.median_ns = hist_percentile(hist, 50);
+    res->repeat.p99_ns    = hist_percentile(hist, 99);
+    res->repeat.max_ns    = hist->max;
+}
+
+// Runs the case once, or as many times as --repeat and --until-fail ask
+// for. Each run is guarded on it's own when there is a timeout, after one
+// timed out the case can't be ran again. Returns 1 if one timed out, 0 if
+// a run was guarded and -1 if not.
+static int ktest_run_repeated(outputInfo* out, TestCase* tc, caseRecord* rec, caseResult* res, unsigned timeout) {
+    const kTestOptions* opts     = rec->opts;
+    latencyHist*        hist     = NULL;
+    uint64_t            failed   = 0;
+    int                 timedout = -1;
+    timerData           first    = { 0 };
+    timerData           last     = { 0 };
+    if(ktest_repeating(tc, opts)) {
+        hist = malloc(sizeof(latencyHist));
+        if(hist != NULL) {
+            hist_init(hist);
+        }
+    }
+    for(uint64_t runs = 1; ; runs++) {
+        caseResult cur = { 0 };
+        timedout = -1;
+        if(timeout) {
+            timedout = ktest_run_guarded(out, tc, rec, &cur, timeout);
+        }
+        if(timedout < 0) {
+            current_case = rec;
+            ktest_exec_case(out, tc, opts, &cur);
+            current_case = NULL;
+        }
+        failed += cur.result != 0;
+        if(runs == 1 || !res->result) {
+            *res = cur;
+        }
+        if(runs == 1) {
+            first = cur.time;
+        }
+        last = cur.time;
+        if(hist != NULL) {
+            hist_add(hist, timer_get_ns(&(cur.time)));
+        }
+        if(timedout > 0) {
+            rec->quiet = 0;
+            ktest_timed_out(rec, timer_get_ns(&(cur.time)), timeout);
+            break;
+        }
+        if(hist == NULL || (failed && opts->until_fail) || runs == opts->repeat) {
+            break;
+        }
+        rec->quiet |= failed != 0;
+    }
+    if(hist != NULL) {
+        res->time.t0 = first.t0;
+        res->time.t1 = last.t1;
+        ktest_repeat_stats(res, hist, failed);
+        free(hist);
+    }
+    rec->quiet = 0;
+    return timedout;
+}
+
+// Fails a case of a suite fixture that could not be built without running
+// any of it. The fixture is built by the harness itself, even with --fork.
+static void ktest_suite_failed(outputInfo* out, TestCase* tc, const kTestOptions* opts) {
+    caseResult res = {
+        .result = 1
+    };
+    caseRecord rec = {
+        .tc   = tc,
+        .out  = out,
+        .opts = opts,
+        .live = 1
+    };
+    ktest_report_case_start(&rec);
+    fprintf(out->output, "%s+===========================+\n", out->fg.l_red);
+    fprintf(out->output, "| %s  SUITE FIXTURE FAILED%s   |\n", out->bold, out->normal);
+    fprintf(out->output, "+===========================+%s\n", out->reset);
+    ktest_record_add(&rec, NULL, 0, "suite fixture %s failed in the harness, the case was not ran", tc->suite->name);
+    ktest_report_case_end(&rec, &res);
+    free(rec.failures);
+}
+
+int ktest_run_test_case(outputInfo* out, TestCase* tc, const kTestOptions* opts) {
+    caseResult res = { 0 };
+    caseRecord rec = {
+        .tc   = tc,
+        .out  = out,
+        .opts = opts,
+        .live = 1
+    };
+    if(ktest_suite_acquire(out, tc->suite)) {
+        ktest_suite_release(out, tc->suite);
+        ktest_suite_failed(out, tc, opts);
+        return 1;
+    }
+    ktest_report_case_start(&rec);
+    int timedout = ktest_run_repeated(out, tc, &rec, &res, ktest_case_timeout(tc, opts));
+    ktest_report_case_end(&rec, &res);
+    // The abandoned case may still be using the suite fixture so it is
+    // never torn down.
+    if(timedout <= 0) {
+        ktest_suite_release(out, tc->suite);
+    }
+    free(rec.failures);
+    return res.result;
+}
+
+static void ktest_run_worker_case(void* ctx, size_t worker, size_t item) {
+    parallelRun*  run = ctx;
+    workerOutput* w   = run->workers + worker;
+    TestCase*     tc  = run->tests[run->cases[item]];
+    if(w->out.output == NULL && worker_output_open(w, run->out)) {
+        // No private buffer so hold the lock for the whole case instead.
+        pthread_mutex_lock(&(run->lock));
+        w->failures += ktest_run_test_case(run->out, tc, run->opts);
+        pthread_mutex_unlock(&(run->lock));
+        return;
+    }
+    w->failures += ktest_run_test_case(&(w->out), tc, run->opts);
+    pthread_mutex_lock(&(run->lock));
+    worker_output_flush(w, run->out->output);
+    pthread_mutex_unlock(&(run->lock));
+}
+
+// Benchmarks are kept apart from the rest so they can have the machine
+// to themselves.
+static int ktest_selected(const TestCase* tc, int bench) {
+    return !tc->skip && tc->bench == bench;
+}
+
+static int ktest_ordered(const kTestOptions* opts) {
+    return opts->history_path != NULL || opts->order != ORDER_REGISTERED;
+}
+
+// The pool gives every worker a block of cases to start on, so dealing the
+// ordered cases out over those blocks has each worker start on the first
+// of them rather than only the first worker.
+static void ktest_deal_cases(size_t* cases, size_t count, size_t jobs) {
+    size_t* dealt = malloc(sizeof(size_t) * (count + 1));
+    if(dealt == NULL) {
+        return;
+    }
+    size_t per   = count / jobs;
+    size_t extra = count % jobs;
+    for(size_t i = 0; i < count; i++) {
+        size_t worker = i % jobs;
+        size_t start  = worker * per + (worker < extra ? worker : extra);
+        dealt[start + i / jobs] = cases[i];
+    }
+    memcpy(cases, dealt, sizeof(size_t) * count);
+    free(dealt);
+}
+
+// Returns -1 if the parallel run could not be set up, in which case no
+// test case was ran. Otherwise returns the number of failures.
+static int ktest_run_parallel(outputInfo* out, const kTestList* list, const kTestOptions* opts, size_t jobs, size_t count, int bench) {
+    int         failures = 0;
+    parallelRun run      = {
+        .out     = out,
+        .opts    = opts,
+        .tests   = list->tests,
+        .cases   = malloc(sizeof(size_t) * count),
+        .workers = calloc(jobs, sizeof(workerOutput))
+    };
+    if(run.cases == NULL || run.workers == NULL || pthread_mutex_init(&(run.lock), NULL) != 0) {
+        free(run.cases);
+        free(run.workers);
+        return -1;
+    }
+
+    size_t n = 0;
+    for(size_t i = 0; i < list->count; i++) {
+        if(ktest_selected(list->tests[i], bench)) {
+            run.cases[n++] = i;
+        }
+    }
+    if(ktest_ordered(opts)) {
+        ktest_deal_cases(run.cases, count, jobs);
+    }
+    pool_run(jobs, count, ktest_run_worker_case, &run);
+    for(size_t i = 0; i < jobs; i++) {
+        failures += run.workers[i].failures;
+        worker_output_close(run.workers + i);
+    }
+    pthread_mutex_destroy(&(run.lock));
+    free(run.cases);
+    free(run.workers);
+    return failures;
+}
+
+#if CURRENT_OS == OS_LINUX || CURRENT_OS == OS_UNIX_LIKE
+// A test case running in it's own process. Anything the child writes
+// comes back through out_fd while the caseResult, followed by the number
+// of failures and the failures, comes back through res_fd once the case
+// is done. A child still running past it's deadline is killed.
+typedef struct {
+    pid_t      pid;
+    int        out_fd;
+    int        res_fd;
+    TestCase*  tc;
+    char*      buf;
+    size_t     len;
+    size_t     cap;
+    char*      res_buf;
+    size_t     res_len;
+    size_t     res_cap;
+    caseResult res;
+    timerData  t;
+    uint64_t   deadline;
+    unsigned   timeout_ms;
+    int        timed_out;
+} forkChild;
+
+static void write_all(int fd, const void* data, size_t len) {
+    const char* cur = data;
+    while(len) {
+        ssize_t amt = write(fd, cur, len);
+        if(amt < 0 && errno == EINTR) {
+            continue;
+        }
+        if(amt <= 0) {
+            return;
+        }
+        cur += amt;
+        len -= amt;
+    }
+}
+
+static void ktest_fork_child(outputInfo* out, TestCase* tc, const kTestOptions* opts, int out_fd, int res_fd) {
+    caseResult res   = { 0 };
+    outputInfo child = *out;
+    caseRecord rec   = {
+        .tc   = tc,
+        .out  = &child,
+        .opts = opts
+    };
+    // The runners of the parent are not running in here.
+    case_runner = NULL;
+    runners     = NULL;
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(out_fd, STDERR_FILENO);
+    close(out_fd);
+    // Line buffered so a child killed for running too long still gets
+    // to show what it printed.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    child.output = stdout;
+    // The parent only kills a child that runs a case once, a repeated
+    // one guards each run itself.
+    ktest_run_repeated(&child, tc, &rec, &res, ktest_repeating(tc, opts) ? ktest_case_timeout(tc, opts) : 0);
+    fflush(stdout);
+    fflush(stderr);
+    // The file names point into the same image in the parent so only the
+    // structs need to be sent.
+    write_all(res_fd, &res, sizeof(res));
+    write_all(res_fd, &(rec.count), sizeof(rec.count));
+    write_all(res_fd, rec.failures, sizeof(caseFailure) * rec.count);
+    _exit(0);
+}
+
+static int ktest_fork_spawn(outputInfo* out, forkChild* c, TestCase* tc, const kTestOptions* opts) {
+    int out_pipe[2];
+    int res_pipe[2];
+    if(pipe(out_pipe) != 0) {
+        return 1;
+    }
+    if(pipe(res_pipe) != 0) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return 1;
+    }
+    // Anything still buffered would be written again by the child.
+    fflush(NULL);
+    memset(c, 0, sizeof(*c));
+    c->timeout_ms = ktest_repeating(tc, opts) ? 0 : ktest_case_timeout(tc, opts);
+    if(c->timeout_ms) {
+        c->deadline = timer_now_ns() + (uint64_t)c->timeout_ms * 1000000;
+    }
+    timer_start(&(c->t));
+    c->pid = fork();
+    if(c->pid == 0) {
+        close(out_pipe[0]);
+        close(res_pipe[0]);
+        ktest_fork_child(out, tc, opts, out_pipe[1], res_pipe[1]);
+    }
+    close(out_pipe[1]);
+    close(res_pipe[1]);
+    if(c->pid < 0) {
+        close(out_pipe[0]);
+        close(res_pipe[0]);
+        c->pid = 0;
+        return 1;
+    }
+    c->tc     = tc;
+    c->out_fd = out_pipe[0];
+    c->res_fd = res_pipe[0];
+    return 0;
+}
+
+static void fork_append(char** buf, size_t* len, size_t* cap, const char* data, size_t amt) {
+    if(*len + amt > *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 4096;
+        while(new_cap < *len + amt) {
+            new_cap *= 2;
+        }
+        char* new = realloc(*buf, new_cap);
+        if(new == NULL) {
+            return;
+        }
+        *buf = new;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, data, amt);
+    *len += amt;
+}
+
+// Reads what is available from one of the child's pipes, closing it once
+// the child closes it's end.
+static void ktest_fork_read(forkChild* c, int* fd) {
+    char    chunk[4096];
+    ssize_t amt = read(*fd, chunk, sizeof(chunk));
+    if(amt < 0 && errno == EINTR) {
+        return;
+    }
+    if(amt <= 0) {
+        close(*fd);
+        *fd = -1;
+        return;
+    }
+    if(*fd == c->res_fd) {
+        fork_append(&(c->res_buf), &(c->res_len), &(c->res_cap), chunk, amt);
+    } else {
+        fork_append(&(c->buf), &(c->len), &(c->cap), chunk, amt);
+    }
+}
+
+// Unpacks what the child sent back, returns zero if it never got to send
+// it's result.
+static int ktest_fork_result(forkChild* c, caseRecord* rec) {
+    size_t count = 0;
+    size_t off   = sizeof(c->res) + sizeof(count);
+    if(c->res_len < sizeof(c->res)) {
+        return 0;
+    }
+    memcpy(&(c->res), c->res_buf, sizeof(c->res));
+    if(c->res_len >= off) {
+        memcpy(&count, c->res_buf + sizeof(c->res), sizeof(count));
+    }
+    if(count == 0 || count > (c->res_len - off) / sizeof(caseFailure)) {
+        return 1;
+    }
+    rec->failures = malloc(sizeof(caseFailure) * count);
+    if(rec->failures != NULL) {
+        memcpy(rec->failures, c->res_buf + off, sizeof(caseFailure) * count);
+        rec->count = count;
+        rec->cap   = count;
+    }
+    return 1;
+}
+
+static int ktest_fork_finish(outputInfo* out, forkChild* c, const kTestOptions* opts) {
+    int        status = 0;
+    caseRecord rec    = {
+        .tc   = c->tc,
+        .out  = out,
+        .opts = opts,
+        .live = 1
+    };
+    while(waitpid(c->pid, &status, 0) < 0 && errno == EINTR);
+    timer_stop(&(c->t));
+
+    int complete = ktest_fork_result(c, &rec);
+    free(c->res_buf);
+    c->res_buf = NULL;
+
+    ktest_report_case_start(&rec);
+    fwrite(c->buf, 1, c->len, out->output);
+    free(c->buf);
+    c->buf = NULL;
+    for(size_t i = 0; i < rec.count; i++) {
+        ktest_report_assert_fail(&rec, rec.failures + i);
+    }
+
+    if(!complete) {
+        // The child never got to report back, so just use the time as
+        // seen from this side.
+        c->res.time   = c->t;
+        c->res.result = 1;
+    }
+    if(c->timed_out) {
+        ktest_timed_out(&rec, timer_get_ns(&(c->t)), c->timeout_ms);
+        c->res.result = 1;
+    } else if(WIFSIGNALED(status)) {
+        fprintf(
+            out->output,
+            "  %sTerminated%s : %s (signal %d)\n",
+            out->fg.l_red,
+            out->reset,
+            strsignal(WTERMSIG(status)),
+            WTERMSIG(status)
+        );
+        ktest_record_add(&rec, NULL, 0, "terminated by %s (signal %d)", strsignal(WTERMSIG(status)), WTERMSIG(status));
+        c->res.result = 1;
+    } else if(WIFEXITED(status) && (WEXITSTATUS(status) != 0 || !complete)) {
+        fprintf(out->output, "   %sExit Code%s : %d\n", out->fg.l_red, out->reset, WEXITSTATUS(status));
+        ktest_record_add(&rec, NULL, 0, "exited with code %d", WEXITSTATUS(status));
+        c->res.result = 1;
+    }
+    ktest_report_case_end(&rec, &(c->res));
+    ktest_suite_release(out, c->tc->suite);
+    free(rec.failures);
+    c->pid = 0;
+    return c->res.result;
+}
+
+static void ktest_fork_failed(outputInfo* out, TestCase* tc, const kTestOptions* opts) {
+    caseResult res = {
+        .result = 1
+    };
+    caseRecord rec = {
+        .tc   = tc,
+        .out  = out,
+        .opts = opts,
+        .live = 1
+    };
+    ktest_report_case_start(&rec);
+    fprintf(out->output, "%s+===========================+\n", out->fg.l_red);
+    fprintf(out->output, "| %s  STARTING PROCESS FAILED%s |\n", out->bold, out->normal);
+    fprintf(out->output, "+===========================+%s\n", out->reset);
+    ktest_record_add(&rec, NULL, 0, "starting process failed");
+    ktest_report_case_end(&rec, &res);
+    free(rec.failures);
+}
+
+// How long poll can wait before the next child is due to be killed.
+static int ktest_fork_wait_ms(const forkChild* kids, size_t jobs) {
+    uint64_t now  = timer_now_ns();
+    int      wait = -1;
+    for(size_t i = 0; i < jobs; i++) {
+        if(kids[i].pid == 0 || kids[i].deadline == 0 || kids[i].timed_out) {
+            continue;
+        }
+        uint64_t left = kids[i].deadline > now ? kids[i].deadline - now : 0;
+        uint64_t ms   = (left + 999999) / 1000000;
+        if(ms > INT_MAX) {
+            ms = INT_MAX;
+        }
+        if(wait < 0 || (int)ms < wait) {
+            wait = (int)ms;
+        }
+    }
+    return wait;
+}
+
+// Kills the children past their deadline. Their pipes close once they are
+// gone, which finishes them like any other.
+static void ktest_fork_kill_late(forkChild* kids, size_t jobs) {
+    uint64_t now = timer_now_ns();
+    for(size_t i = 0; i < jobs; i++) {
+        forkChild* c = kids + i;
+        if(c->pid != 0 && c->deadline != 0 && !c->timed_out && now >= c->deadline) {
+            kill(c->pid, SIGKILL);
+            c->timed_out = 1;
+        }
+    }
+}
+
+// Runs every selected case in a child process of it's own with up to jobs
+// of them at once.
+static int ktest_run_forked(outputInfo* out, const kTestList* list, const kTestOptions* opts, size_t jobs, int bench) {
+    int            failures = 0;
+    size_t         next     = 0;
+    size_t         active   = 0;
+    forkChild*     kids     = calloc(jobs, sizeof(forkChild));
+    struct pollfd* fds      = calloc(jobs * 2, sizeof(struct pollfd));
+    if(kids == NULL || fds == NULL) {
+        free(kids);
+        free(fds);
+        return -1;
+    }
+
+    for(;;) {
+        // A case that fails before it's child starts leaves the slot free
+        // for the next one.
+        for(size_t i = 0; i < jobs && next < list->count; i++) {
+            while(kids[i].pid == 0 && next < list->count) {
+                TestCase* tc = list->tests[next++];
+                if(!ktest_selected(tc, bench)) {
+                    continue;
+                }
+                // Built on this side so every child gets a copy of the same
+                // one, which also means it is not isolated like the cases are.
+                if(ktest_suite_acquire(out, tc->suite)) {
+                    ktest_suite_release(out, tc->suite);
+                    ktest_suite_failed(out, tc, opts);
+                    failures++;
+                    continue;
+                }
+                if(ktest_fork_spawn(out, kids + i, tc, opts)) {
+                    ktest_suite_release(out, tc->suite);
+                    ktest_fork_failed(out, tc, opts);
+                    failures++;
+                    continue;
+                }
+                active++;
+            }
+        }
+        if(active == 0) {
+            break;
+        }
+
+        nfds_t nfds = 0;
+        for(size_t i = 0; i < jobs; i++) {
+            fds[2 * i].fd         = kids[i].pid ? kids[i].out_fd : -1;
+            fds[2 * i].events     = POLLIN;
+            fds[2 * i].revents    = 0;
+            fds[2 * i + 1].fd     = kids[i].pid ? kids[i].res_fd : -1;
+            fds[2 * i + 1].events = POLLIN;
+            fds[2 * i + 1].revents = 0;
+            nfds += 2;
+        }
+        int ready = poll(fds, nfds, ktest_fork_wait_ms(kids, jobs));
+        ktest_fork_kill_late(kids, jobs);
+        if(ready < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            // Fall back to blocking reads on whatever is still open
+            for(size_t i = 0; i < nfds; i++) {
+                fds[i].revents = fds[i].fd >= 0 ? POLLIN : 0;
+            }
+        }
+        for(size_t i = 0; i < jobs; i++) {
+            forkChild* c = kids + i;
+            if(c->pid == 0) {
+                continue;
+            }
+            if(fds[2 * i].revents && c->out_fd >= 0) {
+                ktest_fork_read(c, &(c->out_fd));
+            }
+            if(fds[2 * i + 1].revents && c->res_fd >= 0) {
+                ktest_fork_read(c, &(c->res_fd));
+            }
+            if(c->out_fd < 0 && c->res_fd < 0) {
+                failures += ktest_fork_finish(out, c, opts);
+                active--;
+            }
+        }
+    }
+    free(kids);
+    free(fds);
+    return failures;
+}
+#endif
+
+static void ktest_print_skip(outputInfo* out, const char* name) {
+    fprintf(out->output, "+===========================+\n");
+    fprintf(
+        out->output,
+        "[   %s%sSkipping%s : %s%-13s%s]\n",
+        out->bold,
+        out->fg.l_yellow,
+        out->reset,
+        out->fg.l_cyan,
+        name,
+        out->reset
+    );
+}
+
+// Runs the selected cases over the requested number of workers or
+// processes. Falls back to this thread if those could not be set up.
+static int ktest_run_phase(outputInfo* out, const kTestList* list, const kTestOptions* opts, size_t jobs, int bench) {
+    int    failures = -1;
+    size_t count    = 0;
+    for(size_t i = 0; i < list->count; i++) {
+        count += ktest_selected(list->tests[i], bench);
+    }
+    if(count == 0) {
+        return 0;
+    }
+    if(jobs > count) {
+        jobs = count;
+    }
+
+    #if CURRENT_OS == OS_LINUX || CURRENT_OS == OS_UNIX_LIKE
+    if(opts->fork) {
+        failures = ktest_run_forked(out, list, opts, jobs, bench);
+    } else
+    #endif
+    if(jobs > 1) {
+        failures = ktest_run_parallel(out, list, opts, jobs, count, bench);
+    }
+
+    if(failures < 0) {
+        failures = 0;
+        for(size_t i = 0; i < list->count; i++) {
+            if(ktest_selected(list->tests[i], bench)) {
+                failures += ktest_run_test_case(out, list->tests[i], opts);
+            }
+        }
+    }
+    return failures;
+}
+
+static void ktest_format_bytes(size_t bytes, char buffer[24]) {
+    if(bytes == 0) {
+        snprintf(buffer, 24, "?");
+    } else if(bytes % (1024 * 1024) == 0) {
+        snprintf(buffer, 24, "%zuMiB", bytes / (1024 * 1024));
+    } else if(bytes % 1024 == 0) {
+        snprintf(buffer, 24, "%zuKiB", bytes / 1024);
+    } else {
+        snprintf(buffer, 24, "%zuB", bytes);
+    }
+}
+
+static void ktest_print_machine_warn(outputInfo* out, const char* msg) {
+    fprintf(out->output, "     %sWarning%s : %s\n", out->fg.l_red, out->reset, msg);
+}
+
+// Printed ahead of any run with benchmarks in it, the numbers mean little
+// without knowing what they were measured on.
+static void ktest_print_machine(outputInfo* out, const machineInfo* m) {
+    char l1[24];
+    char l2[24];
+    char l3[24];
+    char msg[96];
+    ktest_format_bytes(m->l1d_size, l1);
+    ktest_format_bytes(m->l2_size, l2);
+    ktest_format_bytes(m->l3_size, l3);
+    fprintf(out->output, "         %sCPU%s : %s\n", out->fg.l_yellow, out->reset, m->cpu_model[0] ? m->cpu_model : "unknown");
+    fprintf(
+        out->output,
+        "    %sTopology%s : %zu core%s, %zu thread%s, %zu NUMA node%s\n",
+        out->fg.l_yellow,
+        out->reset,
+        m->cores,
+        m->cores == 1 ? "" : "s",
+        m->threads,
+        m->threads == 1 ? "" : "s",
+        m->numa_nodes,
+        m->numa_nodes == 1 ? "" : "s"
+    );
+    fprintf(out->output, "      %sCaches%s : L1d %s, L2 %s, L3 %s", out->fg.l_yellow, out->reset, l1, l2, l3);
+    if(m->line_size) {
+        fprintf(out->output, ", %zuB lines", m->line_size);
+    }
+    if(m->max_mhz) {
+        snprintf(msg, sizeof(msg), "%zuMHz max", m->max_mhz);
+    } else {
+        snprintf(msg, sizeof(msg), "max unknown");
+    }
+    fprintf(
+        out->output,
+        "\n   %sFrequency%s : %s, governor %s, turbo %s\n",
+        out->fg.l_yellow,
+        out->reset,
+        msg,
+        m->governor[0] ? m->governor : "unknown",
+        m->turbo < 0 ? "unknown" : m->turbo ? "on" : "off"
+    );
+    if(m->governor[0] && strcmp(m->governor, "performance") != 0) {
+        snprintf(msg, sizeof(msg), "governor is %s rather than performance, clocks may ramp mid run", m->governor);
+        ktest_print_machine_warn(out, msg);
+    }
+    if(m->turbo == 1) {
+        ktest_print_machine_warn(out, "turbo is on, clocks will follow load and temperature");
+    }
+    if(m->load_avg >= 0 && m->load_avg * 2 > (double)m->threads) {
+        snprintf(msg, sizeof(msg), "load average is %.2f on %zu threads, others are competing", m->load_avg, m->threads);
+        ktest_print_machine_warn(out, msg);
+    }
+}
+
+static void ktest_print_suite_start(outputInfo* out, const char* name, size_t count) {
+    fprintf(out->output, "+===========================+\n");
+    fprintf(
+        out->output,
+        "| %sRunning%s: %s%-17s%s|\n",
+        out->fg.l_blue,
+        out->reset,
+        out->fg.l_cyan,
+        name,
+        out->reset
+    );
+    fprintf(
+        out->output,
+        "| %sTest Cases%s: %s%s%-14zu%s|\n",
+        out->fg.l_blue,
+        out->reset,
+        out->bold,
+        out->fg.l_magenta,
+        count,
+        out->reset
+    );
+}
+
+static void ktest_print_summary(outputInfo* out, const runSummary* sum) {
+    int passed   = sum->passed;
+    int failures = sum->failed;
+    int skipped  = sum->skipped;
+    fprintf(out->output, "+===========================+\n");
+    fprintf(
+        out->output,
+        "Summary for %s'%s'%s\n",
+        out->fg.l_cyan,
+        sum->name,
+        out->reset
+    );
+    fprintf(
+        out->output,
+        "Test Cases %sPassed%s : %s%s%d%s\n",
+        passed > 0 ? out->fg.l_green : "",
+        out->reset,
+        passed > 0 ? out->bold : "",
+        passed > 0 ? out->fg.l_magenta : "",
+        passed,
+        out->reset
+    );
+    fprintf(
+        out->output,
+        "Test Cases %sFailed%s : %s%s%d%s\n",
+        failures ? out->fg.l_red : "",
+        out->reset,
+        failures > 0 ? out->bold : "",
+        failures > 0 ? out->fg.l_magenta : "",
+        failures,
+        out->reset
+    );
+    fprintf(
+        out->output,
+        "Test Cases %sSkipped%s : %s%s%d%s\n",
+        skipped ? out->fg.l_yellow : "",
+        out->reset,
+        skipped > 0 ? out->bold : "",
+        skipped > 0 ? out->fg.l_magenta : "",
+        skipped,
+        out->reset
+    );
+
+    char buffer[14] = { 0 };
+    timer_format_ns_u64(sum->ns, buffer);
+    fprintf(
+        out->output,
+        "       %sTotal Time%s : %s%s%s\n",
+        out->fg.l_yellow,
+        out->reset,
+        out->fg.l_magenta,
+        buffer,
+        out->reset
+    );
+}
+
+// The console output is just another reporter, it writes to the output of
+// whoever is running the case.
+static void console_suite_start(reporter* r, outputInfo* out, const char* suite, size_t count) {
+    (void)r;
+    ktest_print_suite_start(out, suite, count);
+}
+
+static void console_case_start(reporter* r, outputInfo* out, const caseReport* c) {
+    (void)r;
+    ktest_print_case_start(out, c->name);
+}
+
+static void console_case_end(reporter* r, outputInfo* out, const caseReport* c) {
+    ktest_print_case_result(out, c->res, r->data);
+}
+
+static void console_case_skip(reporter* r, outputInfo* out, const caseReport* c) {
+    (void)r;
+    ktest_print_skip(out, c->name);
+}
+
+static void console_summary(reporter* r, outputInfo* out, const runSummary* s) {
+    (void)r;
+    ktest_print_summary(out, s);
+}
+
+static const reporterOps console_ops = {
+    .suite_start = console_suite_start,
+    .case_start  = console_case_start,
+    .case_end    = console_case_end,
+    .case_skip   = console_case_skip,
+    .summary     = console_summary
+};
+
+int ktest_run_tests(outputInfo* out, const char* name, const kTestList* list, const kTestOptions* opts) {
+    int failures = 0;
+    int skipped  = 0;
+    timerData  t = { 0 };
 
-    char buffer[14] = { 0 };
-    timer_get_str(&t, buffer);
-    fprintf(
-        out->output,
-        "       %sTotal Time%s : %s%s%s\n",
-        out->fg.l_yellow,
-        out->reset,
-        out->fg.l_magenta,
-        buffer,
-        out->reset
-    );
+    if(ktest_has_bench(list)) {
+        ktest_print_machine(out, get_machine_info());
+    }
+    ktest_report_suite_start(out, opts, name, list->count);
+    ktest_suite_count_users(list);
+    timer_start(&t);
+    if(opts->jobs > 1 || opts->fork) {
+        for(size_t i = 0; i < list->count; i++) {
+            if(list->tests[i]->skip) {
+                ktest_report_case_skip(out, opts, list->tests[i]);
+                skipped++;
+            }
+        }
+        failures  = ktest_run_phase(out, list, opts, opts->jobs, 0);
+        failures += ktest_run_phase(out, list, opts, 1, 1);
+    } else {
+        for(size_t i = 0; i < list->count; i++) {
+            if(list->tests[i]->skip) {
+                ktest_report_case_skip(out, opts, list->tests[i]);
+                skipped++;
+                continue;
+            }
+            failures += ktest_run_test_case(out, list->tests[i], opts);
+        }
+    }
+    timer_stop(&t);
+    ktest_runners_stop();
+
+    runSummary sum = {
+        .name    = name,
+        .passed  = (int)list->count - failures - skipped,
+        .failed  = failures,
+        .skipped = skipped,
+        .ns      = timer_get_ns(&t)
+    };
+    ktest_report_summary(out, opts, &sum);
     return failures;
 }
 
-int ktest_str_eq(FILE* out, const char* file, unsigned line, const char* str1, const char* str2) {
-    const char* cur1 = str1;
-    const char* cur2 = str2;
-    // Compare manually instead of using strcmp so I know where they differ.
-    while(*cur1 && *cur2 && (*cur1 == *cur2)) {
-        cur1++;
-        cur2++;
+static void ktest_format_value(char* buf, size_t len, const kTestValue* v) {
+    switch(v->type) {
+        case KTEST_VAL_INT:
+            snprintf(buf, len, "%"PRId64, v->val.i);
+            break;
+        case KTEST_VAL_UINT:
+            snprintf(buf, len, "%"PRIu64, v->val.u);
+            break;
+        case KTEST_VAL_FLOAT:
+            snprintf(buf, len, "%f", v->val.f);
+            break;
+        case KTEST_VAL_LDOUBLE:
+            snprintf(buf, len, "%Lf", v->val.ld);
+            break;
+        default:
+            snprintf(buf, len, "%p", (void*)v->val.p);
+            break;
+    }
+}
+
+void ktest_fail_cmp(kTestStatus* status, const char* file, unsigned line, const char* kind, const char* cmp, const kTestValue* x, const kTestValue* y) {
+    FILE* out      = status->output;
+    char  xs[64];
+    char  ys[64];
+    status->result = 1;
+    ktest_format_value(xs, sizeof(xs), x);
+    ktest_format_value(ys, sizeof(ys), y);
+    ktest_report_failure(file, line, "%s : {value} %s %s, Actual : %s %s %s", kind, cmp, ys, xs, cmp, ys);
+    if(out == NULL) {
+        return;
+    }
+    fprintf(out, "Test Failure : %s:%u\n", file, line);
+    fprintf(out, "    %s : {value} %s %s\n", kind, cmp, ys);
+    fprintf(out, "      Actual : %s %s %s\n\n", xs, cmp, ys);
+}
+
+void ktest_fail_bool(kTestStatus* status, const char* file, unsigned line, const char* kind, int expected, const kTestValue* x) {
+    FILE* out      = status->output;
+    char  xs[64]   = "false";
+    status->result = 1;
+    // Every type stores zero and one the same way in the integer members
+    // but the floats.
+    int is_int = x->type == KTEST_VAL_INT || x->type == KTEST_VAL_UINT;
+    if(is_int && x->val.u == 1) {
+        strcpy(xs, "true");
+    } else if(!is_int || x->val.u != 0) {
+        ktest_format_value(xs, sizeof(xs), x);
     }
+    ktest_report_failure(file, line, "%s : %s, Actual : %s", kind, expected ? "true" : "false", xs);
+    if(out == NULL) {
+        return;
+    }
+    fprintf(out, "Test Failure : %s:%u\n", file, line);
+    fprintf(out, "    %s : %s\n", kind, expected ? "true" : "false");
+    fprintf(out, "      Actual : %s\n\n", xs);
+}
+
+// Strings longer than this are shown as a hex diff around where they
+// differ rather than in full.
+#define KTEST_STR_SHOW_MAX 120
+
+int ktest_str_eq(FILE* out, const char* file, unsigned line, const char* str1, const char* str2) {
+    // Not strcmp so I know where they differ.
+    size_t      good_bytes = str_mismatch(str1, str2);
+    const char* cur1       = str1 + good_bytes;
+    const char* cur2       = str2 + good_bytes;
     if(*cur1 != *cur2) {
-        size_t good_bytes = cur1 - str1;
         char fmt[48] = { 0 };
+        ktest_report_failure(file, line, "Expected : \"%s\", Actual : \"%s\"", str2, str1);
+        if(out == NULL) {
+            return 1;
+        }
         fprintf(out,      "Test Failure : %s:%u\n", file, line);
+        size_t len1 = good_bytes + strlen(cur1);
+        size_t len2 = good_bytes + strlen(cur2);
+        if(good_bytes > KTEST_STR_SHOW_MAX || len1 - good_bytes > KTEST_STR_SHOW_MAX || len2 - good_bytes > KTEST_STR_SHOW_MAX) {
+            // Both strings are readable up to and including the shorter
+            // one's terminator, so the rows after the difference are shown
+            // too.
+            fprintf(out, "    Expected : %zu characters\n", len2);
+            fprintf(out, "      Actual : %zu characters, differs at %zu\n", len1, good_bytes);
+            mem_print_diff(out, str1, str2, (len1 < len2 ? len1 : len2) + 1, good_bytes);
+            fputc('\n', out);
+            return 1;
+        }
         fprintf(out,      "    Expected : %s\n", str2);
         snprintf(fmt, 47, "      Actual : %%.%zus", good_bytes);
         fprintf(out, fmt, str1);
         // Make sure it's not the NULL byte
         if(*cur1) {
             fprintf(out, "%s%c%s%s\n", get_fg_color_if_tty(L_RED, out), *cur1, get_reset_if_tty(out), cur1 + 1);
+        } else {
+            fputc('\n', out);
         }
         // print pointer to where it first differs
         fprintf(out, "               "); // Padding
@@ -318,6 +2179,10 @@ int ktest_str_eq(FILE* out, const char* file, unsigned line, const char* str1, c
 
 int ktest_str_ne(FILE* out, const char* file, unsigned line, const char* str1, const char* str2) {
     if(strcmp(str1, str2) == 0) {
+        ktest_report_failure(file, line, "Not Expected : \"%s\"", str2);
+        if(out == NULL) {
+            return 1;
+        }
         fprintf(out, "Test Failure : %s:%u\n", file, line);
         fprintf(out, "Not Expected : %s\n", str2);
         fprintf(out, "      Actual : %s%s%s\n\n", get_fg_color_if_tty(L_RED, out), str2, get_reset_if_tty(out));
@@ -326,6 +2191,123 @@ int ktest_str_ne(FILE* out, const char* file, unsigned line, const char* str1, c
     return 0;
 }
 
+int ktest_mem_eq(FILE* out, const char* file, unsigned line, const void* actual, const void* expected, size_t len) {
+    if(actual == expected || len == 0) {
+        return 0;
+    }
+    if(actual == NULL || expected == NULL) {
+        ktest_report_failure(file, line, "Expected : %zu equal bytes, Actual : NULL buffer", len);
+        if(out != NULL) {
+            fprintf(out, "Test Failure : %s:%u\n", file, line);
+            fprintf(out, "    Expected : %zu equal bytes\n", len);
+            fprintf(out, "      Actual : %s%s%s buffer\n\n", get_fg_color_if_tty(L_RED, out), "NULL", get_reset_if_tty(out));
+        }
+        return 1;
+    }
+    size_t at = mem_mismatch(actual, expected, len);
+    if(at == len) {
+        return 0;
+    }
+    const unsigned char* a = actual;
+    const unsigned char* e = expected;
+    ktest_report_failure(file, line, "Expected : %zu equal bytes, Actual : 0x%02x at %zu where 0x%02x was expected", len, a[at], at, e[at]);
+    if(out == NULL) {
+        return 1;
+    }
+    fprintf(out, "Test Failure : %s:%u\n", file, line);
+    fprintf(out, "    Expected : %zu equal bytes\n", len);
+    fprintf(out, "      Actual : differs at offset %zu (0x%zx)\n", at, at);
+    mem_print_diff(out, actual, expected, len, at);
+    fputc('\n', out);
+    return 1;
+}
+
+static uint64_t ktest_ulps(double tol) {
+    if(!(tol > 0)) {
+        return 0;
+    }
+    return tol >= (double)UINT64_MAX ? UINT64_MAX : (uint64_t)tol;
+}
+
+static size_t ktest_near_worst(const floatStats* st, int mode) {
+    switch(mode) {
+        case KTEST_NEAR_REL:
+            return st->at_rel;
+        case KTEST_NEAR_ULP:
+            return st->at_ulp;
+        default:
+            return st->at_abs;
+    }
+}
+
+static void ktest_near_fail(FILE* out, const char* file, unsigned line, size_t count, size_t far, int mode, double tol,
+                            const floatStats* st, double actual, double expected, int digits) {
+    char   within[48];
+    size_t worst = ktest_near_worst(st, mode);
+    if(mode == KTEST_NEAR_ULP) {
+        snprintf(within, sizeof(within), "%"PRIu64" ULP", ktest_ulps(tol));
+    } else {
+        snprintf(within, sizeof(within), mode == KTEST_NEAR_REL ? "%g relative" : "%g", tol);
+    }
+    if(count == 1) {
+        ktest_report_failure(file, line, "Expected : %.*g within %s, Actual : %.*g", digits, expected, within, digits, actual);
+        if(out == NULL) {
+            return;
+        }
+        fprintf(out, "Test Failure : %s:%u\n", file, line);
+        fprintf(out, "    Expected : %.*g within %s\n", digits, expected, within);
+        fprintf(out, "      Actual : %s%.*g%s, off by %g (%g relative, %"PRIu64" ULP)\n\n", get_fg_color_if_tty(L_RED, out), digits, actual,
+                get_reset_if_tty(out), st->max_abs, st->max_rel, st->max_ulp);
+        return;
+    }
+    ktest_report_failure(file, line, "Expected : %zu elements within %s, Actual : %zu outside, worst at [%zu] %.*g where %.*g was expected",
+                         count, within, far, worst, digits, actual, digits, expected);
+    if(out == NULL) {
+        return;
+    }
+    fprintf(out, "Test Failure : %s:%u\n", file, line);
+    fprintf(out, "    Expected : %zu elements within %s\n", count, within);
+    fprintf(out, "      Actual : %s%zu%s outside, worst at [%zu] %.*g where %.*g was expected\n", get_fg_color_if_tty(L_RED, out), far,
+            get_reset_if_tty(out), worst, digits, actual, digits, expected);
+    fprintf(out, "     Max Abs : %g at [%zu]\n", st->max_abs, st->at_abs);
+    fprintf(out, "     Max Rel : %g at [%zu]\n", st->max_rel, st->at_rel);
+    fprintf(out, "     Max ULP : %"PRIu64" at [%zu]\n\n", st->max_ulp, st->at_ulp);
+}
+
+int ktest_near_f32(FILE* out, const char* file, unsigned line, const float* actual, const float* expected, size_t count, int mode, double tol) {
+    size_t far;
+    if(mode == KTEST_NEAR_ULP) {
+        far = float_ulp_far_f32(actual, expected, count, ktest_ulps(tol));
+    } else {
+        far = float_far_f32(actual, expected, count, mode == KTEST_NEAR_ABS ? tol : 0, mode == KTEST_NEAR_REL ? tol : 0);
+    }
+    if(far == 0) {
+        return 0;
+    }
+    floatStats st;
+    float_stats_f32(actual, expected, count, &st);
+    size_t worst = ktest_near_worst(&st, mode);
+    ktest_near_fail(out, file, line, count, far, mode, tol, &st, (double)actual[worst], (double)expected[worst], FLT_DECIMAL_DIG);
+    return 1;
+}
+
+int ktest_near_f64(FILE* out, const char* file, unsigned line, const double* actual, const double* expected, size_t count, int mode, double tol) {
+    size_t far;
+    if(mode == KTEST_NEAR_ULP) {
+        far = float_ulp_far_f64(actual, expected, count, ktest_ulps(tol));
+    } else {
+        far = float_far_f64(actual, expected, count, mode == KTEST_NEAR_ABS ? tol : 0, mode == KTEST_NEAR_REL ? tol : 0);
+    }
+    if(far == 0) {
+        return 0;
+    }
+    floatStats st;
+    float_stats_f64(actual, expected, count, &st);
+    size_t worst = ktest_near_worst(&st, mode);
+    ktest_near_fail(out, file, line, count, far, mode, tol, &st, actual[worst], expected[worst], DBL_DECIMAL_DIG);
+    return 1;
+}
+
 void print_err_cmd(outputInfo* err, const char* prog, const char* cmd, const char* msg) {
     fprintf(
         err->output,
@@ -341,7 +2323,211 @@ void print_err_cmd(outputInfo* err, const char* prog, const char* cmd, const cha
     );
 }
 
-int process_args(int argc, char** argv, kTestList* list) {
+// Parses a strictly positive count such as the number of jobs.
+static int parse_count(const char* str, size_t* out) {
+    char*              end = NULL;
+    unsigned long long val = strtoull(str, &end, 10);
+    if(*str == '\0' || *str == '-' || *end != '\0' || val == 0) {
+        return 1;
+    }
+    *out = val;
+    return 0;
+}
+
+// Parses an index, which unlike a count can be zero.
+static int parse_index(const char* str, size_t* out) {
+    if(strcmp(str, "0") == 0) {
+        *out = 0;
+        return 0;
+    }
+    return parse_count(str, out);
+}
+
+// Options that take the next argument as their value.
+static int arg_has_value(const char* arg) {
+    return strcmp("-j", arg) == 0 ||
+           strcmp("--bench-time", arg) == 0 ||
+           strcmp("--bench-cpu", arg) == 0 ||
+           strcmp("--bench-warmup", arg) == 0 ||
+           strcmp("--bench-mad", arg) == 0 ||
+           strcmp("--filter", arg) == 0 ||
+           strcmp("--filter-file", arg) == 0 ||
+           strcmp("--reporter", arg) == 0 ||
+           strcmp("--save-baseline", arg) == 0 ||
+           strcmp("--compare-baseline", arg) == 0 ||
+           strcmp("--regression-threshold", arg) == 0 ||
+           strcmp("--shard-index", arg) == 0 ||
+           strcmp("--shard-count", arg) == 0 ||
+           strcmp("--shard-timings", arg) == 0 ||
+           strcmp("--timeout", arg) == 0 ||
+           strcmp("--history", arg) == 0 ||
+           strcmp("--order", arg) == 0 ||
+           strcmp("--seed", arg) == 0 ||
+           strcmp("--prop-seed", arg) == 0 ||
+           strcmp("--prop-iters", arg) == 0 ||
+           strcmp("--repeat", arg) == 0;
+}
+
+// Parses a strictly positive percentage.
+static int parse_percent(const char* str, double* out) {
+    char*  end = NULL;
+    double val = strtod(str, &end);
+    if(*str == '\0' || *end != '\0' || !(val > 0)) {
+        return 1;
+    }
+    *out = val;
+    return 0;
+}
+
+static int ktest_add_baseline(outputInfo* err, const char* prog, kTestOptions* opts) {
+    if(opts->save_baseline == NULL && opts->compare_baseline == NULL) {
+        return 0;
+    }
+    if(opts->reporter_count >= KTEST_MAX_REPORTERS) {
+        print_err_cmd(err, prog, "--save-baseline", "too many reporters for");
+        return 1;
+    }
+    reporter* r = opts->reporters + opts->reporter_count;
+    switch(baseline_reporter_init(r, opts->save_baseline, opts->compare_baseline, opts->regression_pct / 100)) {
+        case 0:
+            break;
+        case 1:
+            print_err_cmd(err, prog, opts->compare_baseline, "can not read baseline file");
+            return 1;
+        default:
+            print_err_cmd(err, prog, opts->save_baseline, "can not open baseline file");
+            return 1;
+    }
+    opts->baseline = r;
+    opts->reporter_count++;
+    return 0;
+}
+
+// The history of the last run is read before the reporter writing this
+// one replaces it. A missing file is just an empty history.
+static int ktest_add_history(outputInfo* err, const char* prog, kTestOptions* opts) {
+    if(opts->history_path == NULL) {
+        if(opts->order == ORDER_SHORTEST || opts->order == ORDER_LONGEST) {
+            print_err_cmd(err, prog, "--history", "ordering by duration needs");
+            return 1;
+        }
+        return 0;
+    }
+    if(opts->reporter_count >= KTEST_MAX_REPORTERS) {
+        print_err_cmd(err, prog, "--history", "too many reporters for");
+        return 1;
+    }
+    if(baseline_load(&(opts->history), opts->history_path)) {
+        baseline_free(&(opts->history));
+    }
+    if(history_reporter_init(opts->reporters + opts->reporter_count, opts->history_path, &(opts->history))) {
+        print_err_cmd(err, prog, opts->history_path, "can not open history file");
+        return 1;
+    }
+    opts->reporter_count++;
+    return 0;
+}
+
+// Adds a reporter from "name" or "name=file". The console is always there
+// so asking for it does nothing. Returns why it could not be added or NULL.
+static const char* ktest_add_reporter(kTestOptions* opts, const char* spec) {
+    char        name[16] = { 0 };
+    size_t      len      = strcspn(spec, "=");
+    const char* file     = spec[len] == '=' ? spec + len + 1 : NULL;
+    reporter*   r        = opts->reporters + opts->reporter_count;
+    if(len >= sizeof(name)) {
+        return "unknown reporter";
+    }
+    memcpy(name, spec, len);
+    if(strcmp(name, "console") == 0) {
+        return file == NULL ? NULL : "console reporter can not write to a file";
+    }
+    if(opts->reporter_count >= KTEST_MAX_REPORTERS) {
+        return "too many reporters";
+    }
+    if(file == NULL) {
+        for(size_t i = 0; i < opts->reporter_count; i++) {
+            if(opts->reporters[i].output == stdout) {
+                return "only one reporter can write to stdout";
+            }
+        }
+    }
+    switch(reporter_init(r, name, file)) {
+        case 0:
+            break;
+        case 1:
+            return "unknown reporter";
+        default:
+            return "can not open report file";
+    }
+    opts->reporter_count++;
+    return NULL;
+}
+
+// A reporter writing to stdout moves the console output over to stderr.
+static int ktest_stdout_taken(int argc, char** argv) {
+    for(int i = 1; i + 1 < argc; i++) {
+        if(strcmp("--reporter", argv[i]) == 0) {
+            if(strchr(argv[i + 1], '=') == NULL && strcmp(argv[i + 1], "console") != 0) {
+                return 1;
+            }
+            i++;
+        }
+    }
+    return 0;
+}
+
+// Marks the cases the patterns in filter match. Names without wildcards
+// are looked up in the index so only the globs need a pass over every case.
+static void ktest_filter_mark(kTestList* list, const filterList* filter, unsigned char* keep, int negative) {
+    for(const char* pat = filter_next(filter, NULL); pat != NULL; pat = filter_next(filter, pat)) {
+        size_t id = 0;
+        if((pat[0] == '-') != negative) {
+            continue;
+        }
+        const char* glob = pat + negative;
+        if(!glob_has_wild(glob) && list->index.slots != NULL) {
+            if(name_index_find(&(list->index), glob, &id)) {
+                keep[id] = !negative;
+            }
+            continue;
+        }
+        for(size_t j = 0; j < list->count; j++) {
+            if(glob_match(glob, list->tests[j]->name)) {
+                keep[j] = !negative;
+            }
+        }
+    }
+}
+
+// Drops every case that is not matched by at least one positive pattern,
+// if there are any, or that is matched by a negative one.
+static int ktest_apply_filter(kTestList* list, const filterList* filter) {
+    int positive = 0;
+    for(const char* pat = filter_next(filter, NULL); pat != NULL; pat = filter_next(filter, pat)) {
+        positive |= pat[0] != '-';
+    }
+    unsigned char* keep = malloc(list->count + 1);
+    if(keep == NULL) {
+        return 1;
+    }
+    memset(keep, !positive, list->count + 1);
+    ktest_filter_mark(list, filter, keep, 0);
+    ktest_filter_mark(list, filter, keep, 1);
+
+    size_t n = 0;
+    for(size_t i = 0; i < list->count; i++) {
+        if(keep[i]) {
+            list->tests[n++] = list->tests[i];
+        }
+    }
+    free(keep);
+    list->count = n;
+    ktest_index_cases(list);
+    return 0;
+}
+
+static int ktest_parse_args(int argc, char** argv, kTestList* list, kTestOptions* opts, filterList* filter) {
     outputInfo  output = { 0 };
     outputInfo* err    = &output;
     console_set_output_info(err, stderr);
@@ -357,6 +2543,269 @@ int process_args(int argc, char** argv, kTestList* list) {
             run += 1;
             continue;
         }
+        if(strncmp("-j", argv[i], 2) == 0) {
+            const char* val = argv[i] + 2;
+            if(arg_has_value(argv[i])) {
+                if(i + 1 >= argc) {
+                    print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                    return 1;
+                }
+                val = argv[++i];
+            }
+            if(parse_count(val, &(opts->jobs))) {
+                print_err_cmd(err, argv[0], val, "invalid job count");
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--bench-time", argv[i]) == 0) {
+            size_t ms = 0;
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(parse_count(argv[++i], &ms)) {
+                print_err_cmd(err, argv[0], argv[i], "invalid benchmark time");
+                return 1;
+            }
+            opts->bench.target_ns = (uint64_t)ms * 1000000;
+            continue;
+        }
+        if(strcmp("--bench-cpu", argv[i]) == 0) {
+            size_t cpu = 0;
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(parse_index(argv[++i], &cpu) || cpu > INT_MAX) {
+                print_err_cmd(err, argv[0], argv[i], "invalid benchmark cpu");
+                return 1;
+            }
+            opts->bench.cpu = (int)cpu;
+            continue;
+        }
+        if(strcmp("--bench-warmup", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(parse_index(argv[++i], &(opts->bench.warmup))) {
+                print_err_cmd(err, argv[0], argv[i], "invalid benchmark warmup");
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--bench-mad", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(parse_percent(argv[++i], &(opts->bench.mad_limit))) {
+                print_err_cmd(err, argv[0], argv[i], "invalid outlier limit");
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--bench-priority", argv[i]) == 0) {
+            opts->bench.priority = 1;
+            continue;
+        }
+        if(strcmp("--bench-cold", argv[i]) == 0) {
+            opts->bench.cold = 1;
+            continue;
+        }
+        if(strcmp("--filter", argv[i]) == 0 || strcmp("--filter-file", argv[i]) == 0) {
+            int from_file = argv[i][8] != '\0';
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            i++;
+            if(from_file ? filter_add_file(filter, argv[i]) : filter_add(filter, argv[i])) {
+                print_err_cmd(err, argv[0], argv[i], from_file ? "can not read filter file" : "can not add filter");
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--reporter", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            const char* msg = ktest_add_reporter(opts, argv[++i]);
+            if(msg != NULL) {
+                print_err_cmd(err, argv[0], argv[i], msg);
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--save-baseline", argv[i]) == 0 || strcmp("--compare-baseline", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(argv[i][2] == 's') {
+                opts->save_baseline = argv[++i];
+            } else {
+                opts->compare_baseline = argv[++i];
+            }
+            continue;
+        }
+        if(strcmp("--regression-threshold", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(parse_percent(argv[++i], &(opts->regression_pct))) {
+                print_err_cmd(err, argv[0], argv[i], "invalid regression threshold");
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--shard-index", argv[i]) == 0 || strcmp("--shard-count", argv[i]) == 0) {
+            int is_index = argv[i][8] == 'i';
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            i++;
+            if(is_index ? parse_index(argv[i], &(opts->shard_index)) : parse_count(argv[i], &(opts->shard_count))) {
+                print_err_cmd(err, argv[0], argv[i], is_index ? "invalid shard index" : "invalid shard count");
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--timeout", argv[i]) == 0) {
+            size_t ms = 0;
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            i++;
+            if(parse_index(argv[i], &ms) || ms > UINT_MAX) {
+                print_err_cmd(err, argv[0], argv[i], "invalid timeout");
+                return 1;
+            }
+            opts->timeout_ms = (unsigned)ms;
+            continue;
+        }
+        if(strcmp("--history", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            opts->history_path = argv[++i];
+            continue;
+        }
+        if(strcmp("--order", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            i++;
+            if(strcmp("registered", argv[i]) == 0) {
+                opts->order = ORDER_REGISTERED;
+            } else if(strcmp("shortest", argv[i]) == 0) {
+                opts->order = ORDER_SHORTEST;
+            } else if(strcmp("longest", argv[i]) == 0) {
+                opts->order = ORDER_LONGEST;
+            } else {
+                print_err_cmd(err, argv[0], argv[i], "unknown order");
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--shuffle", argv[i]) == 0) {
+            opts->order = ORDER_SHUFFLE;
+            opts->seed  = timer_now_ns();
+            continue;
+        }
+        if(strcmp("--seed", argv[i]) == 0) {
+            size_t seed = 0;
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(parse_index(argv[++i], &seed)) {
+                print_err_cmd(err, argv[0], argv[i], "invalid seed");
+                return 1;
+            }
+            opts->order = ORDER_SHUFFLE;
+            opts->seed  = seed;
+            continue;
+        }
+        if(strcmp("--prop-seed", argv[i]) == 0) {
+            size_t seed = 0;
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(parse_index(argv[++i], &seed)) {
+                print_err_cmd(err, argv[0], argv[i], "invalid property seed");
+                return 1;
+            }
+            opts->prop_seed = seed;
+            continue;
+        }
+        if(strcmp("--repeat", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(parse_count(argv[++i], &(opts->repeat))) {
+                print_err_cmd(err, argv[0], argv[i], "invalid repeat count");
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--until-fail", argv[i]) == 0) {
+            opts->until_fail = 1;
+            continue;
+        }
+        if(strcmp("--prop-iters", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            if(parse_count(argv[++i], &(opts->prop_iters))) {
+                print_err_cmd(err, argv[0], argv[i], "invalid property iterations");
+                return 1;
+            }
+            continue;
+        }
+        if(strcmp("--shard-timings", argv[i]) == 0) {
+            if(i + 1 >= argc) {
+                print_err_cmd(err, argv[0], argv[i], "missing argument to");
+                return 1;
+            }
+            opts->shard_timings = argv[++i];
+            continue;
+        }
+        if(strcmp("--track-allocs", argv[i]) == 0) {
+            opts->allocs = 1;
+            continue;
+        }
+        if(strcmp("--perf", argv[i]) == 0) {
+            opts->perf = 1;
+            continue;
+        }
+        if(strcmp("--update-golden", argv[i]) == 0) {
+            opts->update_golden = 1;
+            continue;
+        }
+        if(strcmp("--guard-fixtures", argv[i]) == 0) {
+            opts->guard = 1;
+            continue;
+        }
+        if(strcmp("--fork", argv[i]) == 0) {
+            #if CURRENT_OS == OS_LINUX || CURRENT_OS == OS_UNIX_LIKE
+            opts->fork = 1;
+            continue;
+            #else
+            print_err_cmd(err, argv[0], argv[i], "not supported on this platform");
+            return 1;
+            #endif
+        }
         if(argv[i][0] == '-') {
             print_err_cmd(err, argv[0], argv[i], "unrecognized command-line option");
             return 1;
@@ -367,6 +2816,20 @@ int process_args(int argc, char** argv, kTestList* list) {
         }
     }
 
+    if(ktest_add_baseline(err, argv[0], opts)) {
+        return 1;
+    }
+    if(ktest_add_history(err, argv[0], opts)) {
+        return 1;
+    }
+
+    if(opts->shard_index >= opts->shard_count) {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), "%zu", opts->shard_index);
+        print_err_cmd(err, argv[0], buffer, "shard index is past the shard count");
+        return 1;
+    }
+
     if(skip && run) {
         fprintf(
             err->output,
@@ -392,7 +2855,14 @@ int process_args(int argc, char** argv, kTestList* list) {
         ktest_skip_all(list);
     }
 
-    for(int i = 2; i < argc; i++) {
+    for(int i = 1; i < argc; i++) {
+        if(arg_has_value(argv[i])) {
+            i++;
+            continue;
+        }
+        if(argv[i][0] == '-') {
+            continue;
+        }
         if(!ktest_set_skip(list, argv[i], skip)) {
             print_err_cmd(err, argv[0], argv[i], "can not find test case");
             return 1;
@@ -401,15 +2871,128 @@ int process_args(int argc, char** argv, kTestList* list) {
     return 0;
 }
 
+// The cost of each case is its time from the timings file, so each shard
+// takes about as long. Cases missing from it count as the average of the
+// ones that are there. Without timings every case costs the same.
+static int ktest_shard_costs(const kTestList* list, const baselineFile* timings, uint64_t* cost) {
+    uint64_t total = 0;
+    size_t   known = 0;
+    for(size_t i = 0; i < list->count; i++) {
+        const baselineEntry* e = timings ? baseline_find(timings, list->tests[i]->name) : NULL;
+        cost[i] = e != NULL ? e->time_ns + 1 : 0;
+        if(e != NULL) {
+            total += cost[i];
+            known++;
+        }
+    }
+    uint64_t avg = known ? total / known : 1;
+    for(size_t i = 0; i < list->count; i++) {
+        if(cost[i] == 0) {
+            cost[i] = avg;
+        }
+    }
+    return 0;
+}
+
+// Keeps only the cases in this machine's shard. Every shard computes the
+// same partition from the same list, so between them they run every case
+// exactly once.
+static int ktest_apply_shard(const char* prog, kTestList* list, const kTestOptions* opts) {
+    outputInfo   err      = { 0 };
+    baselineFile timings  = { 0 };
+    int          have     = 0;
+    uint64_t*    cost     = malloc(sizeof(uint64_t) * (list->count + 1));
+    size_t*      shard_of = malloc(sizeof(size_t) * (list->count + 1));
+    console_set_output_info(&err, stderr);
+    if(cost == NULL || shard_of == NULL) {
+        free(cost);
+        free(shard_of);
+        return 1;
+    }
+    if(opts->shard_timings != NULL) {
+        // Carry on without them, the split is still deterministic.
+        have = baseline_load(&timings, opts->shard_timings) == 0;
+        if(!have) {
+            print_err_cmd(&err, prog, opts->shard_timings, "can not read shard timings, splitting by count");
+        }
+    }
+    ktest_shard_costs(list, have ? &timings : NULL, cost);
+    int ret = shard_partition(cost, list->count, opts->shard_count, shard_of);
+    if(ret == 0) {
+        size_t n = 0;
+        for(size_t i = 0; i < list->count; i++) {
+            if(shard_of[i] == opts->shard_index) {
+                list->tests[n++] = list->tests[i];
+            }
+        }
+        list->count = n;
+        ktest_index_cases(list);
+    }
+    baseline_free(&timings);
+    free(cost);
+    free(shard_of);
+    return ret;
+}
+
+int process_args(int argc, char** argv, kTestList* list, kTestOptions* opts) {
+    filterList filter = { 0 };
+    // A new seed every run unless one is given to replay a failure.
+    opts->prop_seed   = timer_now_ns();
+    int        ret    = ktest_parse_args(argc, argv, list, opts, &filter);
+    prop_configure(opts->prop_seed, opts->prop_iters);
+    golden_configure(opts->update_golden);
+    // --until-fail on it's own keeps going for as long as it takes.
+    if(opts->repeat == 0 && !opts->until_fail) {
+        opts->repeat = 1;
+    }
+    if(ret == 0 && filter.count > 0) {
+        ret = ktest_apply_filter(list, &filter);
+    }
+    if(ret == 0 && opts->shard_count > 1) {
+        ret = ktest_apply_shard(argv[0], list, opts);
+    }
+    // Ordered after sharding so every shard still splits the same list.
+    if(ret == 0 && ktest_ordered(opts)) {
+        const baselineFile* history = opts->history_path != NULL ? &(opts->history) : NULL;
+        ret = order_cases(list->tests, list->count, history, opts->order, opts->seed);
+        ktest_index_cases(list);
+    }
+    filter_free(&filter);
+    return ret;
+}
+
+static void ktest_close_reporters(kTestOptions* opts) {
+    for(size_t i = 0; i < opts->reporter_count; i++) {
+        reporter_close(opts->reporters + i);
+    }
+    baseline_free(&(opts->history));
+}
+
 int ktest_main(int argc, char** argv, const char* name, int (*test_setup)(kTestList*, char**, int*)) {
     console_init();
     kTestList list  = { 0 };
     char  no_file[] = "NO FILE";
     int   line      = -1;
     char* file      = no_file;
-    int   ret       = -1;
+    int   ret       = KTEST_SUCCESS;
     outputInfo out  = { 0 };
-    console_set_output_info(&out, stdout);
+    reporter reporters[KTEST_MAX_REPORTERS] = { 0 };
+    kTestOptions opts = {
+        .jobs  = get_cpu_count(),
+        .bench = {
+            .target_ns = 200000000,
+            .samples   = BENCH_MAX_SAMPLES,
+            .cpu       = -1
+        },
+        .reporters      = reporters,
+        .reporter_count = 1,
+        .regression_pct = 10,
+        .shard_count    = 1,
+        .timeout_ms     = KTEST_DEFAULT_TIMEOUT_MS
+    };
+    reporters[0].ops  = &console_ops;
+    reporters[0].data = &opts;
+    console_set_output_info(&out, ktest_stdout_taken(argc, argv) ? stderr : stdout);
 
     fprintf(
         out.output,
@@ -419,7 +3002,12 @@ int ktest_main(int argc, char** argv, const char* name, int (*test_setup)(kTestL
         out.reset
     );
 
-    ret = test_setup(&list, &file, &line);
+    if(test_setup != NULL) {
+        ret = test_setup(&list, &file, &line);
+    }
+    if(ret == KTEST_SUCCESS) {
+        ret = ktest_collect_cases(&list);
+    }
     if(ret != KTEST_SUCCESS) {
         fprintf(
             out.output,
@@ -429,7 +3017,7 @@ int ktest_main(int argc, char** argv, const char* name, int (*test_setup)(kTestL
             file,
             line
         );
-        printf("Return Code: %d\n", ret);
+        fprintf(out.output, "Return Code: %d\n", ret);
         ktest_free_tests(&list);
         return EXIT_FAILURE;
     }
@@ -440,13 +3028,82 @@ int ktest_main(int argc, char** argv, const char* name, int (*test_setup)(kTestL
         out.reset
     );
 
-    if(process_args(argc, argv, &list)) {
+    if(process_args(argc, argv, &list, &opts)) {
+        ktest_close_reporters(&opts);
         ktest_free_tests(&list);
         return EXIT_FAILURE;
     }
 
-    ret = ktest_run_tests(&out, name, &list);
+    if(opts.perf) {
+        perfGroup probe = { 0 };
+        int       err   = perf_group_open(&probe);
+        if(err) {
+            // Carry on without them so the same binary works on locked
+            // down machines.
+            fprintf(
+                out.output,
+                "%sPerf Counters%s: unavailable (%s, perf_event_paranoid = %d)\n",
+                out.fg.l_yellow,
+                out.reset,
+                strerror(err),
+                perf_get_paranoid()
+            );
+            opts.perf = 0;
+        }
+        perf_group_close(&probe);
+    }
+
+    if(opts.allocs && !alloc_track_available()) {
+        fprintf(
+            out.output,
+            "%sAllocation Tracking%s: unavailable, link with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free\n",
+            out.fg.l_yellow,
+            out.reset
+        );
+        opts.allocs = 0;
+    }
+
+    if(ktest_has_bench(&list)) {
+        timer_calibrate();
+        fprintf(
+            out.output,
+            "Cycle Timer: %s%s%s %.3fns/cycle, %"PRIu64" cycles overhead\n",
+            out.fg.l_cyan,
+            TIMER_CYCLE_SOURCE,
+            out.reset,
+            timer_ns_per_cycle(),
+            timer_cycle_overhead()
+        );
+    }
+
+    if(opts.order == ORDER_SHUFFLE) {
+        fprintf(
+            out.output,
+            "Shuffled: %sseed %"PRIu64"%s, rerun with --seed to repeat the order\n",
+            out.fg.l_cyan,
+            opts.seed,
+            out.reset
+        );
+    }
+
+    ret = ktest_run_tests(&out, name, &list, &opts);
+    // A slower benchmark fails the run just like a failed test.
+    if(opts.baseline != NULL && baseline_regressions(opts.baseline) > 0) {
+        ret = 1;
+    }
+    ktest_close_reporters(&opts);
+
+    // A case that was given up on may still be running with the tests and
+    // the options, so exit from here with all of them left as they are.
+    pthread_mutex_lock(&report_lock);
+    size_t running = abandoned_running;
+    pthread_mutex_unlock(&report_lock);
+    if(running > 0) {
+        exit(ret ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
     ktest_free_tests(&list);
+    guard_pool_clear();
     if(ret) {
         return EXIT_FAILURE;
     }
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "sys-info.h"
+#include "console.h"
+#include "mem-cmp.h"
+
+#if CURRENT_ARCH == X86_64 && defined(__GNUC__)
+    #include <immintrin.h>
+    #define MEM_CMP_X86
+#elif CURRENT_ARCH == ARM_64 && defined(__GNUC__) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define MEM_CMP_NEON
+#endif
+
+// Bytes per row of the diff, and how many rows are shown either side of
+// the one with the first difference.
+#define DIFF_ROW     16
+#define DIFF_CONTEXT 2
+
+// Compares a word at a time and only goes byte by byte to find which one
+// of them differed.
+static size_t mem_mismatch_scalar(const unsigned char* a, const unsigned char* b, size_t i, size_t len) {
+    for(; i + 8 <= len; i += 8) {
+        uint64_t x;
+        uint64_t y;
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+        if(x != y) {
+            break;
+        }
+    }
+    while(i < len && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+#if defined(MEM_CMP_X86)
+// SSE2 is always there on x86_64. Four vectors are checked at once so the
+// loop is only left once something differs.
+static size_t mem_mismatch_sse2(const unsigned char* a, const unsigned char* b, size_t len) {
+    size_t i = 0;
+    for(; i + 64 <= len; i += 64) {
+        __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)),      _mm_loadu_si128((const __m128i*)(b + i)));
+        __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 16)), _mm_loadu_si128((const __m128i*)(b + i + 16)));
+        __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 32)), _mm_loadu_si128((const __m128i*)(b + i + 32)));
+        __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 48)), _mm_loadu_si128((const __m128i*)(b + i + 48)));
+        __m128i all = _mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3));
+        if(_mm_movemask_epi8(all) != 0xFFFF) {
+            break;
+        }
+    }
+    for(; i + 16 <= len; i += 16) {
+        __m128i eq   = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        int     mask = _mm_movemask_epi8(eq);
+        if(mask != 0xFFFF) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+    return mem_mismatch_scalar(a, b, i, len);
+}
+
+__attribute__((target("avx2")))
+static size_t mem_mismatch_avx2(const unsigned char* a, const unsigned char* b, size_t len) {
+    size_t i = 0;
+    for(; i + 64 <= len; i += 64) {
+        __m256i e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)),      _mm256_loadu_si256((const __m256i*)(b + i)));
+        __m256i e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 32)), _mm256_loadu_si256((const __m256i*)(b + i + 32)));
+        if(_mm256_movemask_epi8(_mm256_and_si256(e0, e1)) != -1) {
+            break;
+        }
+    }
+    for(; i + 32 <= len; i += 32) {
+        __m256i eq   = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        int     mask = _mm256_movemask_epi8(eq);
+        if(mask != -1) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+    return mem_mismatch_scalar(a, b, i, len);
+}
+#endif
+
+#if defined(MEM_CMP_NEON)
+static size_t mem_mismatch_neon(const unsigned char* a, const unsigned char* b, size_t len) {
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        if(vminvq_u8(eq) != 0xFF) {
+            // Narrowing leaves 4 bits for every byte compared.
+            uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+            uint64_t  mask    = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+            return i + __builtin_ctzll(~mask) / 4;
+        }
+    }
+    return mem_mismatch_scalar(a, b, i, len);
+}
+#endif
+
+size_t mem_mismatch(const void* a, const void* b, size_t len) {
+    #if defined(MEM_CMP_X86)
+    if(__builtin_cpu_supports("avx2")) {
+        return mem_mismatch_avx2(a, b, len);
+    }
+    return mem_mismatch_sse2(a, b, len);
+    #elif defined(MEM_CMP_NEON)
+    return mem_mismatch_neon(a, b, len);
+    #else
+    return mem_mismatch_scalar(a, b, 0, len);
+    #endif
+}
+
+// The lengths come from the C library, so neither string is read past
+// it's end even when the other one is longer.
+size_t str_mismatch(const char* a, const char* b) {
+    return mem_mismatch(a, b, strnlen(b, strlen(a)));
+}
+
+static void mem_print_row(FILE* out, const char* label, const unsigned char* buf, const unsigned char* other, size_t start, size_t len) {
+    const char* red   = get_fg_color_if_tty(L_RED, out);
+    const char* reset = get_reset_if_tty(out);
+    fprintf(out, "%12s : %08zx ", label, start);
+    for(size_t i = start; i < start + DIFF_ROW; i++) {
+        if(i >= len) {
+            fputs("   ", out);
+        } else if(buf[i] != other[i]) {
+            fprintf(out, " %s%02x%s", red, buf[i], reset);
+        } else {
+            fprintf(out, " %02x", buf[i]);
+        }
+    }
+    fputs("  |", out);
+    for(size_t i = start; i < start + DIFF_ROW && i < len; i++) {
+        char c = buf[i] >= 0x20 && buf[i] < 0x7F ? (char)buf[i] : '.';
+        if(buf[i] != other[i]) {
+            fprintf(out, "%s%c%s", red, c, reset);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputs("|\n", out);
+}
+
+// Marks the differing bytes of a row for when there is no color.
+static void mem_print_marks(FILE* out, const unsigned char* a, const unsigned char* b, size_t start, size_t len) {
+    char hex[DIFF_ROW * 3 + 1];
+    char ascii[DIFF_ROW + 1];
+    int  any = 0;
+    for(size_t i = 0; i < DIFF_ROW; i++) {
+        int diff = start + i < len && a[start + i] != b[start + i];
+        memcpy(hex + i * 3, diff ? " ^^" : "   ", 3);
+        ascii[i] = diff ? '^' : ' ';
+        any |= diff;
+    }
+    hex[DIFF_ROW * 3] = '\0';
+    ascii[DIFF_ROW]   = '\0';
+    if(any) {
+        fprintf(out, "%12s   %8s %s   %s\n", "", "", hex, ascii);
+    }
+}
+
+void mem_print_diff(FILE* out, const void* actual, const void* expected, size_t len, size_t at) {
+    const unsigned char* a     = actual;
+    const unsigned char* e     = expected;
+    size_t               row   = at / DIFF_ROW;
+    size_t               first = row > DIFF_CONTEXT ? row - DIFF_CONTEXT : 0;
+    size_t               last  = len ? (len - 1) / DIFF_ROW : 0;
+    if(row + DIFF_CONTEXT < last) {
+        last = row + DIFF_CONTEXT;
+    }
+    if(first > 0) {
+        fprintf(out, "%12s   ...\n", "");
+    }
+    for(size_t r = first; r <= last; r++) {
+        mem_print_row(out, "Expected", e, a, r * DIFF_ROW, len);
+        mem_print_row(out, "Actual", a, e, r * DIFF_ROW, len);
+        mem_print_marks(out, a, e, r * DIFF_ROW, len);
+    }
+    if((last + 1) * DIFF_ROW < len) {
+        fprintf(out, "%12s   ...\n", "");
+    }
+}
@@ -0,0 +1,161 @@
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "order.h"
+#include "rng.h"
+
+typedef struct {
+    kTestCase* tc;
+    uint32_t   since_fail;
+    uint64_t   key;
+    size_t     pos;
+} orderItem;
+
+typedef struct {
+    const baselineFile* old;
+    unsigned char*      seen;
+} historyState;
+
+static int order_is_recent(const orderItem* item) {
+    return item->since_fail < ORDER_RECENT_RUNS;
+}
+
+static int order_compare(const void* a, const void* b) {
+    const orderItem* x = a;
+    const orderItem* y = b;
+    int xr = order_is_recent(x);
+    int yr = order_is_recent(y);
+    if(xr != yr) {
+        return yr - xr;
+    }
+    // The most recent failures go first.
+    if(xr && x->since_fail != y->since_fail) {
+        return x->since_fail < y->since_fail ? -1 : 1;
+    }
+    if(x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+int order_cases(kTestCase** cases, size_t count, const baselineFile* history, orderPolicy policy, uint64_t seed) {
+    orderItem* items = malloc(sizeof(orderItem) * (count + 1));
+    if(items == NULL) {
+        return 1;
+    }
+    uint64_t total = 0;
+    size_t   known = 0;
+    for(size_t i = 0; i < count; i++) {
+        const baselineEntry* e = history ? baseline_find(history, cases[i]->name) : NULL;
+        items[i].tc         = cases[i];
+        items[i].since_fail = e != NULL ? e->since_fail : BASELINE_NEVER_FAILED;
+        items[i].key        = e != NULL ? e->time_ns + 1 : 0;
+        items[i].pos        = i;
+        if(e != NULL) {
+            total += items[i].key;
+            known++;
+        }
+    }
+
+    uint64_t avg = known ? total / known : 1;
+    for(size_t i = 0; i < count; i++) {
+        uint64_t cost = items[i].key ? items[i].key : avg;
+        switch(policy) {
+            case ORDER_SHORTEST:
+                items[i].key = cost;
+                break;
+            case ORDER_LONGEST:
+                items[i].key = UINT64_MAX - cost;
+                break;
+            case ORDER_SHUFFLE:
+                // Sorting by a random key is as good as a shuffle, and
+                // keeps the recent failures in front all the same.
+                items[i].key = rng_splitmix64(&seed);
+                break;
+            default:
+                items[i].key = 0;
+                break;
+        }
+    }
+    qsort(items, count, sizeof(orderItem), order_compare);
+    for(size_t i = 0; i < count; i++) {
+        cases[i] = items[i].tc;
+    }
+    free(items);
+    return 0;
+}
+
+static void history_write(FILE* out, const char* name, int failed, uint64_t ns, uint32_t since_fail) {
+    fputs("{\"case\":", out);
+    report_write_json_str(out, name);
+    fprintf(out, ",\"result\":\"%s\",\"time_ns\":%"PRIu64, failed ? "failed" : "passed", ns);
+    if(since_fail != BASELINE_NEVER_FAILED) {
+        fprintf(out, ",\"since_fail\":%"PRIu32, since_fail);
+    }
+    fputs("}\n", out);
+}
+
+static void history_case_end(reporter* r, outputInfo* out, const caseReport* c) {
+    historyState* st    = r->state;
+    uint32_t      since = BASELINE_NEVER_FAILED;
+    size_t        id    = 0;
+    int           found = name_index_find(&(st->old->index), c->name, &id);
+    (void)out;
+    if(found) {
+        st->seen[id] = 1;
+        since = st->old->entries[id].since_fail;
+        since = since < BASELINE_NEVER_FAILED - 1 ? since + 1 : since;
+    }
+    if(c->res->result) {
+        since = 0;
+    }
+    history_write(r->output, c->name, c->res->result, timer_get_ns(&(c->res->time)), since);
+}
+
+static void history_close(reporter* r) {
+    historyState* st = r->state;
+    if(st == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < st->old->count; i++) {
+        const baselineEntry* e = st->old->entries + i;
+        if(!st->seen[i]) {
+            history_write(r->output, st->old->names + e->name, e->since_fail == 0, e->time_ns, e->since_fail);
+        }
+    }
+    free(st->seen);
+    free(st);
+    r->state = NULL;
+}
+
+static const reporterOps history_ops = {
+    .case_end = history_case_end,
+    .close    = history_close
+};
+
+int history_reporter_init(reporter* r, const char* path, const baselineFile* old) {
+    historyState* st = calloc(1, sizeof(historyState));
+    memset(r, 0, sizeof(*r));
+    if(st == NULL) {
+        return 1;
+    }
+    st->old  = old;
+    st->seen = calloc(old->count + 1, 1);
+    if(st->seen == NULL) {
+        free(st);
+        return 1;
+    }
+    r->output = fopen(path, "w");
+    if(r->output == NULL) {
+        free(st->seen);
+        free(st);
+        return 1;
+    }
+    r->close_output = 1;
+    r->ops          = &history_ops;
+    r->state        = st;
+    return 0;
+}
@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+
+#include "perf-counters.h"
+#include "sys-info.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if CURRENT_OS == OS_LINUX
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static void perf_set_attr(struct perf_event_attr* attr, int counter) {
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    switch(counter) {
+        case PERF_CYCLES:
+            attr->type   = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr->type   = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_L1D_MISSES:
+            attr->type   = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_LLC_MISSES:
+            attr->type   = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        default:
+            attr->type   = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+    attr->read_format    = PERF_FORMAT_GROUP |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // Kernel side counting is what perf_event_paranoid usually forbids
+    attr->exclude_kernel = 1;
+    attr->exclude_hv     = 1;
+}
+
+int perf_group_open(perfGroup* group) {
+    int err = 0;
+    memset(group, 0, sizeof(*group));
+    for(int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        struct perf_event_attr attr;
+        int leader = group->count ? group->fds[group->order[0]] : -1;
+        perf_set_attr(&attr, i);
+        // Only the leader starts disabled, the rest follow it.
+        attr.disabled = leader == -1;
+        long fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        group->fds[i] = fd;
+        if(fd < 0) {
+            group->fds[i] = -1;
+            if(err == 0) {
+                err = errno;
+            }
+            continue;
+        }
+        group->order[group->count++] = i;
+    }
+    return group->count ? 0 : (err ? err : ENOENT);
+}
+
+void perf_group_start(perfGroup* group) {
+    if(group->count == 0) {
+        return;
+    }
+    int leader = group->fds[group->order[0]];
+    ioctl(leader, PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_group_stop(perfGroup* group, perfCounts* counts) {
+    // nr, time_enabled, time_running, then a value per counter
+    uint64_t data[3 + PERF_COUNTER_COUNT] = { 0 };
+    memset(counts, 0, sizeof(*counts));
+    if(group->count == 0) {
+        return;
+    }
+    int leader = group->fds[group->order[0]];
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    ssize_t amt = read(leader, data, sizeof(data));
+    if(amt < (ssize_t)(sizeof(uint64_t) * 3) || data[0] != (uint64_t)group->count) {
+        return;
+    }
+    uint64_t enabled = data[1];
+    uint64_t running = data[2];
+    for(int i = 0; i < group->count; i++) {
+        uint64_t val = data[3 + i];
+        // The group was sharing the PMU with others so scale it up.
+        if(running && running < enabled) {
+            val = (uint64_t)((double)val * enabled / running);
+        }
+        counts->have[group->order[i]]   = 1;
+        counts->counts[group->order[i]] = val;
+    }
+    counts->valid = running != 0;
+}
+
+void perf_group_close(perfGroup* group) {
+    for(int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if(group->count && group->fds[i] >= 0) {
+            close(group->fds[i]);
+        }
+        group->fds[i] = -1;
+    }
+    group->count = 0;
+}
+
+int perf_get_paranoid() {
+    int   level = -1;
+    FILE* file  = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+    if(file == NULL) {
+        return -1;
+    }
+    if(fscanf(file, "%d", &level) != 1) {
+        level = -1;
+    }
+    fclose(file);
+    return level;
+}
+
+#else
+
+int perf_group_open(perfGroup* group) {
+    memset(group, 0, sizeof(*group));
+    return ENOSYS;
+}
+
+void perf_group_start(perfGroup* group) {
+    (void)group;
+}
+
+void perf_group_stop(perfGroup* group, perfCounts* counts) {
+    (void)group;
+    memset(counts, 0, sizeof(*counts));
+}
+
+void perf_group_close(perfGroup* group) {
+    group->count = 0;
+}
+
+int perf_get_paranoid() {
+    return -1;
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+// Every worker owns a range of items. The owner takes items from the
+// head of it's range while idle workers steal from the tail. Both ends
+// are packed into one word so either side can claim an item with a
+// single compare and swap.
+typedef struct {
+    _Atomic uint64_t range; // head in the high 32 bits, tail in the low 32 bits
+    char             pad[56];
+} workQueue;
+
+typedef struct pool_s pool;
+
+typedef struct {
+    pthread_t thread;
+    pool*     owner;
+    size_t    id;
+    int       started;
+} poolWorker;
+
+struct pool_s {
+    size_t      count;
+    workQueue*  queues;
+    poolWorker* workers;
+    poolFn      fn;
+    void*       ctx;
+};
+
+static uint64_t range_pack(uint32_t head, uint32_t tail) {
+    return ((uint64_t)head << 32) | tail;
+}
+
+static int queue_pop(workQueue* q, size_t* item) {
+    uint64_t cur = atomic_load(&(q->range));
+    for(;;) {
+        uint32_t head = cur >> 32;
+        uint32_t tail = (uint32_t)cur;
+        if(head >= tail) {
+            return 0;
+        }
+        if(atomic_compare_exchange_weak(&(q->range), &cur, range_pack(head + 1, tail))) {
+            *item = head;
+            return 1;
+        }
+    }
+}
+
+static int queue_steal(workQueue* q, size_t* item) {
+    uint64_t cur = atomic_load(&(q->range));
+    for(;;) {
+        uint32_t head = cur >> 32;
+        uint32_t tail = (uint32_t)cur;
+        if(head >= tail) {
+            return 0;
+        }
+        if(atomic_compare_exchange_weak(&(q->range), &cur, range_pack(head, tail - 1))) {
+            *item = tail - 1;
+            return 1;
+        }
+    }
+}
+
+static int pool_next(pool* p, size_t id, size_t* item) {
+    if(queue_pop(p->queues + id, item)) {
+        return 1;
+    }
+    // Nothing new is ever queued, so once every queue has been seen empty
+    // the worker is done.
+    for(size_t i = 1; i < p->count; i++) {
+        if(queue_steal(p->queues + ((id + i) % p->count), item)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* pool_worker(void* arg) {
+    poolWorker* w = arg;
+    pool*       p = w->owner;
+    size_t   item = 0;
+    while(pool_next(p, w->id, &item)) {
+        p->fn(p->ctx, w->id, item);
+    }
+    return NULL;
+}
+
+static void pool_run_serial(size_t items, poolFn fn, void* ctx) {
+    for(size_t i = 0; i < items; i++) {
+        fn(ctx, 0, i);
+    }
+}
+
+void pool_run(size_t workers, size_t items, poolFn fn, void* ctx) {
+    if(workers > items) {
+        workers = items;
+    }
+    if(workers <= 1 || items > UINT32_MAX) {
+        pool_run_serial(items, fn, ctx);
+        return;
+    }
+
+    pool p = {
+        .count   = workers,
+        .queues  = aligned_alloc(64, sizeof(workQueue) * workers),
+        .workers = calloc(workers, sizeof(poolWorker)),
+        .fn      = fn,
+        .ctx     = ctx
+    };
+    if(p.queues == NULL || p.workers == NULL) {
+        free(p.queues);
+        free(p.workers);
+        pool_run_serial(items, fn, ctx);
+        return;
+    }
+
+    // Hand out contiguous blocks so neighbouring items stay on one worker
+    // until someone runs dry and starts stealing.
+    size_t per   = items / workers;
+    size_t extra = items % workers;
+    size_t start = 0;
+    for(size_t i = 0; i < workers; i++) {
+        size_t end = start + per + (i < extra);
+        atomic_init(&(p.queues[i].range), range_pack(start, end));
+        p.workers[i].owner = &p;
+        p.workers[i].id    = i;
+        start = end;
+    }
+
+    // If a thread can't be created it's queue is simply stolen by the
+    // others.
+    for(size_t i = 1; i < workers; i++) {
+        p.workers[i].started = pthread_create(&(p.workers[i].thread), NULL, pool_worker, p.workers + i) == 0;
+    }
+    pool_worker(p.workers);
+    for(size_t i = 1; i < workers; i++) {
+        if(p.workers[i].started) {
+            pthread_join(p.workers[i].thread, NULL);
+        }
+    }
+    free(p.queues);
+    free(p.workers);
+}
@@ -0,0 +1,490 @@
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "ktest.h"
+#include "prop.h"
+#include "rng.h"
+#include "reporter.h"
+#include "alloc-track.h"
+
+#define PROP_DEFAULT_ITERS 1000
+// Draws past this many in one input are not kept, so can not be shrunk.
+#define PROP_MAX_CHOICES   4096
+#define PROP_ARENA_SIZE    (64 * 1024)
+// Gives up on shrinking further after running the property this often.
+#define PROP_SHRINK_RUNS   10000
+#define PROP_PRINT_BYTES   32
+
+// Every draw of an input is kept as the choice it came out as, from 0 for
+// the simplest value upwards. Shrinking works on those choices alone so it
+// needs to know nothing about what the values were.
+struct ktest_prop_s {
+    rngState        rng;
+    uint64_t*       choices;
+    size_t          count;
+    const uint64_t* replay;
+    size_t          replay_len;
+    int             replaying;
+    unsigned char*  arena;
+    size_t          arena_used;
+    FILE*           print;
+    size_t          printed;
+};
+
+typedef struct {
+    kTestProp* p;
+    propFn     prop;
+    uint64_t*  best;
+    size_t     len;
+    uint64_t*  cand;
+    size_t     runs;
+} propShrink;
+
+static uint64_t prop_seed  = 0;
+static size_t   prop_iters = PROP_DEFAULT_ITERS;
+
+void prop_configure(uint64_t seed, size_t iters) {
+    prop_seed  = seed;
+    prop_iters = iters ? iters : PROP_DEFAULT_ITERS;
+}
+
+static uint64_t prop_name_seed(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325;
+    while(*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 0x100000001b3;
+    }
+    return prop_seed ^ hash;
+}
+
+// Makes the next choice, from 0 to max. Most are uniform, but the simple
+// values and the far end of the range come up far more often than they
+// would by chance since that is where the bugs tend to be.
+static uint64_t prop_draw(kTestProp* p, uint64_t max) {
+    uint64_t k = 0;
+    if(p->replaying) {
+        k = p->count < p->replay_len ? p->replay[p->count] : 0;
+    } else {
+        uint64_t r = rng_next(&(p->rng));
+        switch(r & 15) {
+            case 0:
+                k = (r >> 4) & 15;
+                break;
+            case 1:
+                k = (r >> 4) & 3;
+                k = max - (k < max ? k : max);
+                break;
+            default:
+                k = rng_next(&(p->rng));
+                break;
+        }
+    }
+    if(max != UINT64_MAX && k > max) {
+        k %= max + 1;
+    }
+    if(p->count < PROP_MAX_CHOICES) {
+        p->choices[p->count] = k;
+    }
+    p->count++;
+    return k;
+}
+
+// Maps a choice onto an offset into a range of max + 1 values where choice
+// 0 is the simplest, then alternating either side of it until one side
+// runs out.
+static uint64_t prop_zigzag(uint64_t k, uint64_t simplest, uint64_t max) {
+    uint64_t below = simplest;
+    uint64_t above = max - simplest;
+    uint64_t near  = below < above ? below : above;
+    if(k <= 2 * near) {
+        if(k == 0) {
+            return simplest;
+        }
+        return k % 2 ? simplest + (k + 1) / 2 : simplest - k / 2;
+    }
+    uint64_t rest = k - 2 * near;
+    return above > below ? simplest + near + rest : simplest - near - rest;
+}
+
+static void prop_print_label(kTestProp* p) {
+    char label[24];
+    snprintf(label, sizeof(label), "Input %zu", ++(p->printed));
+    fprintf(p->print, "%12s : ", label);
+}
+
+int64_t ktest_gen_i64(kTestProp* p, int64_t lo, int64_t hi) {
+    if(lo > hi) {
+        int64_t tmp = lo;
+        lo = hi;
+        hi = tmp;
+    }
+    int64_t  simplest = lo > 0 ? lo : hi < 0 ? hi : 0;
+    uint64_t max      = (uint64_t)hi - (uint64_t)lo;
+    uint64_t off      = prop_zigzag(prop_draw(p, max), (uint64_t)simplest - (uint64_t)lo, max);
+    int64_t  val      = (int64_t)((uint64_t)lo + off);
+    if(p->print != NULL) {
+        prop_print_label(p);
+        fprintf(p->print, "%"PRId64"\n", val);
+    }
+    return val;
+}
+
+uint64_t ktest_gen_u64(kTestProp* p, uint64_t lo, uint64_t hi) {
+    if(lo > hi) {
+        uint64_t tmp = lo;
+        lo = hi;
+        hi = tmp;
+    }
+    uint64_t val = lo + prop_draw(p, hi - lo);
+    if(p->print != NULL) {
+        prop_print_label(p);
+        fprintf(p->print, "%"PRIu64"\n", val);
+    }
+    return val;
+}
+
+// Orders doubles the same as their bits do as unsigned integers, so a
+// range of doubles is a range of keys.
+static uint64_t prop_f64_key(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits >> 63 ? ~bits : bits | (1ULL << 63);
+}
+
+static double prop_f64_from_key(uint64_t key) {
+    uint64_t bits = key >> 63 ? key & ~(1ULL << 63) : ~key;
+    double   x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// Every double in the range is as likely as any other, so the tiny and
+// the huge come up as often as the ones in between.
+double ktest_gen_f64(kTestProp* p, double lo, double hi) {
+    if(isnan(lo) || isnan(hi)) {
+        return NAN;
+    }
+    if(lo > hi) {
+        double tmp = lo;
+        lo = hi;
+        hi = tmp;
+    }
+    double   simplest = lo > 0 ? lo : hi < 0 ? hi : 0;
+    uint64_t lo_key   = prop_f64_key(lo);
+    uint64_t max      = prop_f64_key(hi) - lo_key;
+    uint64_t off      = prop_zigzag(prop_draw(p, max), prop_f64_key(simplest) - lo_key, max);
+    double   val      = prop_f64_from_key(lo_key + off);
+    if(p->print != NULL) {
+        prop_print_label(p);
+        fprintf(p->print, "%.17g\n", val);
+    }
+    return val;
+}
+
+// Takes len bytes from the arena, leaving the next one aligned for
+// anything.
+static unsigned char* prop_arena_take(kTestProp* p, size_t len) {
+    unsigned char* buf = p->arena + p->arena_used;
+    p->arena_used += (len + 15) & ~(size_t)15;
+    if(p->arena_used > PROP_ARENA_SIZE) {
+        p->arena_used = PROP_ARENA_SIZE;
+    }
+    return buf;
+}
+
+void* ktest_gen_bytes(kTestProp* p, size_t max_len, size_t* len) {
+    size_t room = PROP_ARENA_SIZE - p->arena_used;
+    if(max_len > room) {
+        max_len = room;
+    }
+    size_t         n   = prop_draw(p, max_len);
+    unsigned char* buf = prop_arena_take(p, n);
+    for(size_t i = 0; i < n; i++) {
+        buf[i] = (unsigned char)prop_draw(p, 255);
+    }
+    if(p->print != NULL) {
+        prop_print_label(p);
+        fprintf(p->print, "%zu bytes", n);
+        for(size_t i = 0; i < n && i < PROP_PRINT_BYTES; i++) {
+            fprintf(p->print, " %02x", buf[i]);
+        }
+        fputs(n > PROP_PRINT_BYTES ? " ...\n" : "\n", p->print);
+    }
+    *len = n;
+    return buf;
+}
+
+// Printable ASCII shrinking towards 'a'.
+const char* ktest_gen_str(kTestProp* p, size_t max_len) {
+    size_t room = PROP_ARENA_SIZE - p->arena_used;
+    if(room == 0) {
+        return "";
+    }
+    if(max_len > room - 1) {
+        max_len = room - 1;
+    }
+    size_t n   = prop_draw(p, max_len);
+    char*  str = (char*)prop_arena_take(p, n + 1);
+    for(size_t i = 0; i < n; i++) {
+        str[i] = (char)(' ' + prop_zigzag(prop_draw(p, '~' - ' '), 'a' - ' ', '~' - ' '));
+    }
+    str[n] = '\0';
+    if(p->print != NULL) {
+        prop_print_label(p);
+        fputc('"', p->print);
+        for(size_t i = 0; i < n && i < PROP_PRINT_BYTES * 2; i++) {
+            if(str[i] == '"' || str[i] == '\\') {
+                fputc('\\', p->print);
+            }
+            fputc(str[i], p->print);
+        }
+        fputs(n > PROP_PRINT_BYTES * 2 ? "\"...\n" : "\"\n", p->print);
+    }
+    return str;
+}
+
+// Runs the property on one input, returns non-zero if it failed.
+static int prop_run_one(kTestProp* p, propFn prop, kTestStatus* total) {
+    kTestStatus st = {
+        .output = p->print
+    };
+    p->count      = 0;
+    p->arena_used = 0;
+    p->printed    = 0;
+    prop(&st, p);
+    total->asserts += st.asserts;
+    total->expects += st.expects;
+    return st.result;
+}
+
+static size_t prop_kept(const kTestProp* p) {
+    return p->count < PROP_MAX_CHOICES ? p->count : PROP_MAX_CHOICES;
+}
+
+static int prop_simpler(const uint64_t* a, size_t a_len, const uint64_t* b, size_t b_len) {
+    if(a_len != b_len) {
+        return a_len < b_len;
+    }
+    for(size_t i = 0; i < a_len; i++) {
+        if(a[i] != b[i]) {
+            return a[i] < b[i];
+        }
+    }
+    return 0;
+}
+
+// Runs the property on the first len candidate choices, keeping them if
+// it still fails and what it drew is simpler than the best so far.
+static int shrink_try(propShrink* s, size_t len) {
+    kTestStatus ignore = { 0 };
+    if(s->runs >= PROP_SHRINK_RUNS) {
+        return 0;
+    }
+    s->runs++;
+    s->p->replaying  = 1;
+    s->p->replay     = s->cand;
+    s->p->replay_len = len;
+    if(!prop_run_one(s->p, s->prop, &ignore)) {
+        return 0;
+    }
+    size_t used = prop_kept(s->p);
+    if(!prop_simpler(s->p->choices, used, s->best, s->len)) {
+        return 0;
+    }
+    memcpy(s->best, s->p->choices, sizeof(uint64_t) * used);
+    s->len = used;
+    return 1;
+}
+
+// Deleting choices drops whole values, or elements of a buffer when the
+// length before them goes down along with it.
+static int shrink_delete(propShrink* s, size_t size) {
+    int    improved = 0;
+    size_t i        = s->len >= size ? s->len - size + 1 : 0;
+    while(i-- > 0) {
+        if(i + size > s->len) {
+            continue;
+        }
+        memcpy(s->cand, s->best, sizeof(uint64_t) * i);
+        memcpy(s->cand + i, s->best + i + size, sizeof(uint64_t) * (s->len - i - size));
+        size_t len = s->len - size;
+        if(shrink_try(s, len)) {
+            improved = 1;
+            continue;
+        }
+        for(size_t j = i; j > 0 && i - j < 8; j--) {
+            if(s->cand[j - 1] < size) {
+                continue;
+            }
+            s->cand[j - 1] -= size;
+            if(shrink_try(s, len)) {
+                improved = 1;
+                break;
+            }
+            s->cand[j - 1] += size;
+        }
+    }
+    return improved;
+}
+
+static int shrink_zero(propShrink* s, size_t size) {
+    int improved = 0;
+    for(size_t i = 0; i + size <= s->len; i++) {
+        int nonzero = 0;
+        for(size_t j = i; j < i + size; j++) {
+            nonzero |= s->best[j] != 0;
+        }
+        if(!nonzero) {
+            continue;
+        }
+        memcpy(s->cand, s->best, sizeof(uint64_t) * s->len);
+        memset(s->cand + i, 0, sizeof(uint64_t) * size);
+        improved |= shrink_try(s, s->len);
+    }
+    return improved;
+}
+
+// Binary searches each choice down to the smallest that still fails.
+static int shrink_minimize(propShrink* s) {
+    int improved = 0;
+    for(size_t i = 0; i < s->len; i++) {
+        if(s->best[i] == 0) {
+            continue;
+        }
+        memcpy(s->cand, s->best, sizeof(uint64_t) * s->len);
+        s->cand[i] = 0;
+        if(shrink_try(s, s->len)) {
+            improved = 1;
+            continue;
+        }
+        // Odd and even choices sit on either side of the simplest value of
+        // a range, so first search within the side it is on.
+        for(int pass = 0; pass < 2; pass++) {
+            uint64_t step = pass == 0 ? 2 : 1;
+            uint64_t lo   = 0;
+            uint64_t hi   = i < s->len ? s->best[i] / step : 0;
+            if(pass == 0 && hi > 0 && s->best[i] % 2) {
+                memcpy(s->cand, s->best, sizeof(uint64_t) * s->len);
+                s->cand[i] = 1;
+                if(shrink_try(s, s->len)) {
+                    improved = 1;
+                    continue;
+                }
+            }
+            while(i < s->len && hi - lo > 1) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                memcpy(s->cand, s->best, sizeof(uint64_t) * s->len);
+                s->cand[i] = mid * step + s->best[i] % step;
+                if(shrink_try(s, s->len)) {
+                    improved = 1;
+                    hi       = i < s->len ? s->best[i] / step : 0;
+                } else {
+                    lo = mid;
+                }
+            }
+        }
+    }
+    return improved;
+}
+
+static void prop_shrink(propShrink* s) {
+    int improved = 1;
+    while(improved && s->runs < PROP_SHRINK_RUNS) {
+        improved = 0;
+        for(size_t size = 8; size > 0; size /= 2) {
+            improved |= shrink_delete(s, size);
+        }
+        for(size_t size = 8; size > 0; size /= 2) {
+            improved |= shrink_zero(s, size);
+        }
+        improved |= shrink_minimize(s);
+    }
+}
+
+// The buffers are the framework's, not the property's, so they are kept
+// out of the allocations counted for the case.
+static void prop_buffers_free(uint64_t* mem, void* arena) {
+    int paused = alloc_track_pause();
+    free(mem);
+    free(arena);
+    alloc_track_resume(paused);
+}
+
+void ktest_prop_run(kTestStatus* status, const char* name, size_t iters, propFn prop) {
+    kTestProp p      = { 0 };
+    int       paused = alloc_track_pause();
+    uint64_t* mem    = malloc(sizeof(uint64_t) * PROP_MAX_CHOICES * 3);
+    uint64_t  seed   = prop_name_seed(name);
+    size_t    inputs = 0;
+    int       failed = 0;
+    p.arena = malloc(PROP_ARENA_SIZE);
+    alloc_track_resume(paused);
+    if(mem == NULL || p.arena == NULL) {
+        prop_buffers_free(mem, p.arena);
+        status->result = 1;
+        ktest_report_failure(NULL, 0, "allocating property buffers failed");
+        return;
+    }
+    p.choices = mem;
+    rng_seed(&(p.rng), seed);
+
+    // Only the failures of the input that is finally printed count.
+    ktest_report_mute(1);
+    rngState before = p.rng;
+    for(inputs = 0; inputs < (iters ? iters : prop_iters) && !failed; inputs++) {
+        before = p.rng;
+        failed = prop_run_one(&p, prop, status);
+    }
+    if(!failed) {
+        ktest_report_mute(0);
+        prop_buffers_free(mem, p.arena);
+        return;
+    }
+
+    propShrink s = {
+        .p    = &p,
+        .prop = prop,
+        .best = mem + PROP_MAX_CHOICES,
+        .len  = prop_kept(&p),
+        .cand = mem + PROP_MAX_CHOICES * 2
+    };
+    memcpy(s.best, p.choices, sizeof(uint64_t) * s.len);
+    memcpy(s.cand, s.best, sizeof(uint64_t) * s.len);
+    // An input with more draws than were kept may not fail again from the
+    // ones that were, in which case it is printed as it was generated.
+    kTestStatus ignore = { 0 };
+    p.replaying  = 1;
+    p.replay     = s.cand;
+    p.replay_len = s.len;
+    int shrinkable = p.count <= PROP_MAX_CHOICES || prop_run_one(&p, prop, &ignore);
+    if(shrinkable) {
+        prop_shrink(&s);
+    }
+    ktest_report_mute(0);
+
+    if(status->output != NULL) {
+        fprintf(
+            status->output,
+            "    Property : %s falsified by input %zu, shrunk in %zu runs\n",
+            name,
+            inputs,
+            s.runs
+        );
+    }
+    p.print      = status->output;
+    p.replaying  = shrinkable;
+    p.replay     = s.best;
+    p.replay_len = s.len;
+    p.rng        = before;
+    prop_run_one(&p, prop, status);
+    if(status->output != NULL) {
+        fprintf(status->output, "        Seed : %"PRIu64", replay with --prop-seed %"PRIu64"\n\n", prop_seed, prop_seed);
+    }
+    status->result = 1;
+    ktest_report_failure(NULL, 0, "property %s falsified by input %zu, seed %"PRIu64, name, inputs, prop_seed);
+    prop_buffers_free(mem, p.arena);
+}
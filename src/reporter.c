@@ -0,0 +1,393 @@
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "reporter.h"
+
+void report_write_json_str(FILE* out, const char* str) {
+    if(str == NULL) {
+        fputs("null", out);
+        return;
+    }
+    fputc('"', out);
+    for(; *str; str++) {
+        unsigned char c = *str;
+        if(c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if(c == '\n') {
+            fputs("\\n", out);
+        } else if(c == '\t') {
+            fputs("\\t", out);
+        } else if(c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void xml_write_str(FILE* out, const char* str) {
+    for(; *str; str++) {
+        switch(*str) {
+            case '&':  fputs("&amp;",  out); break;
+            case '<':  fputs("&lt;",   out); break;
+            case '>':  fputs("&gt;",   out); break;
+            case '"':  fputs("&quot;", out); break;
+            case '\'': fputs("&apos;", out); break;
+            default:
+                // XML 1.0 has no way to escape most control characters.
+                if((unsigned char)*str >= 0x20 || *str == '\n' || *str == '\t') {
+                    fputc(*str, out);
+                }
+                break;
+        }
+    }
+}
+
+void report_write_json_bench(FILE* out, const benchStats* bench) {
+    fprintf(
+        out,
+        ",\"bench\":{\"iters\":%"PRIu64",\"samples\":%zu,\"min_ns\":%.3f,\"median_ns\":%.3f,"
+        "\"mean_ns\":%.3f,\"stddev_ns\":%.3f,\"p99_ns\":%.3f,\"cycles\":%.1f",
+        bench->iters,
+        bench->samples,
+        bench->min,
+        bench->median,
+        bench->mean,
+        bench->stddev,
+        bench->p99,
+        bench->cycles
+    );
+    if(bench->applied & BENCH_PINNED) {
+        fprintf(out, ",\"cpu\":%d", bench->cpu);
+    }
+    if(bench->applied & BENCH_PRIORITY) {
+        fprintf(out, ",\"priority\":%d", bench->priority);
+    }
+    if(bench->applied & BENCH_WARMUP) {
+        fputs(",\"warmup\":true", out);
+    }
+    if(bench->applied & BENCH_COLD) {
+        fputs(",\"cold\":true", out);
+    }
+    if(bench->applied & BENCH_MAD) {
+        fprintf(out, ",\"outliers\":%zu", bench->outliers);
+    }
+    fputc('}', out);
+}
+
+static void json_write_size(FILE* out, const char* key, size_t value) {
+    if(value) {
+        fprintf(out, ",\"%s\":%zu", key, value);
+    } else {
+        fprintf(out, ",\"%s\":null", key);
+    }
+}
+
+void report_write_json_machine(FILE* out, const machineInfo* m) {
+    fputs("{\"cpu\":", out);
+    report_write_json_str(out, m->cpu_model[0] ? m->cpu_model : NULL);
+    fprintf(out, ",\"cores\":%zu,\"threads\":%zu,\"numa_nodes\":%zu", m->cores, m->threads, m->numa_nodes);
+    json_write_size(out, "l1d_bytes", m->l1d_size);
+    json_write_size(out, "l2_bytes", m->l2_size);
+    json_write_size(out, "l3_bytes", m->l3_size);
+    json_write_size(out, "line_bytes", m->line_size);
+    json_write_size(out, "max_mhz", m->max_mhz);
+    fputs(",\"governor\":", out);
+    report_write_json_str(out, m->governor[0] ? m->governor : NULL);
+    fprintf(out, ",\"turbo\":%s", m->turbo < 0 ? "null" : m->turbo ? "true" : "false");
+    if(m->load_avg >= 0) {
+        fprintf(out, ",\"load_avg\":%.2f}", m->load_avg);
+    } else {
+        fputs(",\"load_avg\":null}", out);
+    }
+}
+
+// Seconds with all nine decimal places, without going through a double.
+static void write_seconds(FILE* out, uint64_t ns) {
+    fprintf(out, "%"PRIu64".%09"PRIu64, ns / 1000000000, ns % 1000000000);
+}
+
+// JSON Lines, one object per event flushed as soon as it is written.
+static void jsonl_suite_start(reporter* r, outputInfo* out, const char* suite, size_t count) {
+    (void)out;
+    fputs("{\"event\":\"suite_start\",\"suite\":", r->output);
+    report_write_json_str(r->output, suite);
+    fprintf(r->output, ",\"cases\":%zu,\"machine\":", count);
+    report_write_json_machine(r->output, get_machine_info());
+    fputs("}\n", r->output);
+    fflush(r->output);
+}
+
+static void jsonl_case_start(reporter* r, outputInfo* out, const caseReport* c) {
+    (void)out;
+    fputs("{\"event\":\"case_start\",\"case\":", r->output);
+    report_write_json_str(r->output, c->name);
+    fputs("}\n", r->output);
+}
+
+static void jsonl_assert_fail(reporter* r, outputInfo* out, const caseReport* c, const caseFailure* f) {
+    (void)out;
+    fputs("{\"event\":\"assert_fail\",\"case\":", r->output);
+    report_write_json_str(r->output, c->name);
+    fputs(",\"file\":", r->output);
+    report_write_json_str(r->output, f->file);
+    fprintf(r->output, ",\"line\":%u,\"message\":", f->line);
+    report_write_json_str(r->output, f->msg);
+    fputs("}\n", r->output);
+}
+
+static void jsonl_case_end(reporter* r, outputInfo* out, const caseReport* c) {
+    (void)out;
+    const caseResult* res = c->res;
+    fputs("{\"event\":\"case_end\",\"case\":", r->output);
+    report_write_json_str(r->output, c->name);
+    fprintf(
+        r->output,
+        ",\"result\":\"%s\",\"asserts\":%u,\"expects\":%u,\"time_ns\":%"PRIu64,
+        res->result ? "failed" : "passed",
+        res->asserts,
+        res->expects,
+        timer_get_ns(&(res->time))
+    );
+    if(res->bench.samples) {
+        report_write_json_bench(r->output, &(res->bench));
+    }
+    if(res->repeat.runs) {
+        fprintf(
+            r->output,
+            ",\"runs\":%"PRIu64",\"failed_runs\":%"PRIu64",\"min_ns\":%"PRIu64",\"median_ns\":%"PRIu64",\"p99_ns\":%"PRIu64",\"max_ns\":%"PRIu64,
+            res->repeat.runs,
+            res->repeat.failed,
+            res->repeat.min_ns,
+            res->repeat.median_ns,
+            res->repeat.p99_ns,
+            res->repeat.max_ns
+        );
+    }
+    fputs("}\n", r->output);
+    fflush(r->output);
+}
+
+static void jsonl_case_skip(reporter* r, outputInfo* out, const caseReport* c) {
+    (void)out;
+    fputs("{\"event\":\"case_skip\",\"case\":", r->output);
+    report_write_json_str(r->output, c->name);
+    fputs("}\n", r->output);
+}
+
+static void jsonl_summary(reporter* r, outputInfo* out, const runSummary* s) {
+    (void)out;
+    fputs("{\"event\":\"summary\",\"suite\":", r->output);
+    report_write_json_str(r->output, s->name);
+    fprintf(
+        r->output,
+        ",\"passed\":%d,\"failed\":%d,\"skipped\":%d,\"time_ns\":%"PRIu64"}\n",
+        s->passed,
+        s->failed,
+        s->skipped,
+        s->ns
+    );
+    fflush(r->output);
+}
+
+static const reporterOps jsonl_ops = {
+    .suite_start = jsonl_suite_start,
+    .case_start  = jsonl_case_start,
+    .assert_fail = jsonl_assert_fail,
+    .case_end    = jsonl_case_end,
+    .case_skip   = jsonl_case_skip,
+    .summary     = jsonl_summary
+};
+
+static void junit_write_property(FILE* out, const char* name, const char* value) {
+    fprintf(out, "      <property name=\"%s\" value=\"", name);
+    xml_write_str(out, value);
+    fputs("\"/>\n", out);
+}
+
+// Only what was found is written, there is no null in XML.
+static void junit_write_machine(FILE* out, const machineInfo* m) {
+    char buffer[32];
+    fputs("    <properties>\n", out);
+    if(m->cpu_model[0]) {
+        junit_write_property(out, "cpu", m->cpu_model);
+    }
+    snprintf(buffer, sizeof(buffer), "%zu", m->cores);
+    junit_write_property(out, "cores", buffer);
+    snprintf(buffer, sizeof(buffer), "%zu", m->threads);
+    junit_write_property(out, "threads", buffer);
+    snprintf(buffer, sizeof(buffer), "%zu", m->numa_nodes);
+    junit_write_property(out, "numa_nodes", buffer);
+    const char*  names[] = { "l1d_bytes", "l2_bytes", "l3_bytes", "line_bytes", "max_mhz" };
+    const size_t sizes[] = { m->l1d_size, m->l2_size, m->l3_size, m->line_size, m->max_mhz };
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if(sizes[i]) {
+            snprintf(buffer, sizeof(buffer), "%zu", sizes[i]);
+            junit_write_property(out, names[i], buffer);
+        }
+    }
+    if(m->governor[0]) {
+        junit_write_property(out, "governor", m->governor);
+    }
+    if(m->turbo >= 0) {
+        junit_write_property(out, "turbo", m->turbo ? "true" : "false");
+    }
+    fputs("    </properties>\n", out);
+}
+
+// JUnit XML. Each testcase element is written whole once the case is done
+// so cases running in parallel never interleave.
+static void junit_suite_start(reporter* r, outputInfo* out, const char* suite, size_t count) {
+    (void)out;
+    r->data = suite;
+    fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n  <testsuite name=\"", r->output);
+    xml_write_str(r->output, suite);
+    fprintf(r->output, "\" tests=\"%zu\">\n", count);
+    junit_write_machine(r->output, get_machine_info());
+    fflush(r->output);
+}
+
+static void junit_case_open(reporter* r, const caseReport* c, uint64_t ns) {
+    fputs("    <testcase name=\"", r->output);
+    xml_write_str(r->output, c->name);
+    fputs("\" classname=\"", r->output);
+    xml_write_str(r->output, r->data);
+    fputs("\" time=\"", r->output);
+    write_seconds(r->output, ns);
+    fputs("\"", r->output);
+}
+
+static void junit_case_end(reporter* r, outputInfo* out, const caseReport* c) {
+    (void)out;
+    junit_case_open(r, c, timer_get_ns(&(c->res->time)));
+    if(!c->res->result) {
+        fputs("/>\n", r->output);
+        fflush(r->output);
+        return;
+    }
+    fputs(">\n", r->output);
+    for(size_t i = 0; i < c->failure_count; i++) {
+        const caseFailure* f = c->failures + i;
+        fputs("      <failure message=\"", r->output);
+        xml_write_str(r->output, f->msg);
+        fputs("\">", r->output);
+        if(f->file != NULL) {
+            xml_write_str(r->output, f->file);
+            fprintf(r->output, ":%u: ", f->line);
+        }
+        xml_write_str(r->output, f->msg);
+        fputs("</failure>\n", r->output);
+    }
+    if(c->failure_count == 0) {
+        fputs("      <failure message=\"failed\"/>\n", r->output);
+    }
+    fputs("    </testcase>\n", r->output);
+    fflush(r->output);
+}
+
+static void junit_case_skip(reporter* r, outputInfo* out, const caseReport* c) {
+    (void)out;
+    junit_case_open(r, c, 0);
+    fputs(">\n      <skipped/>\n    </testcase>\n", r->output);
+}
+
+static void junit_summary(reporter* r, outputInfo* out, const runSummary* s) {
+    (void)out;
+    (void)s;
+    fputs("  </testsuite>\n</testsuites>\n", r->output);
+    fflush(r->output);
+}
+
+static const reporterOps junit_ops = {
+    .suite_start = junit_suite_start,
+    .case_end    = junit_case_end,
+    .case_skip   = junit_case_skip,
+    .summary     = junit_summary
+};
+
+// Test Anything Protocol version 13, with the failures as a YAML block
+// under the test line.
+static void tap_suite_start(reporter* r, outputInfo* out, const char* suite, size_t count) {
+    (void)out;
+    fprintf(r->output, "TAP version 13\n1..%zu\n# ", count);
+    // A newline in the name would end the comment early.
+    for(; *suite && *suite != '\n'; suite++) {
+        fputc(*suite, r->output);
+    }
+    fputs("\n# machine: ", r->output);
+    report_write_json_machine(r->output, get_machine_info());
+    fputc('\n', r->output);
+    fflush(r->output);
+}
+
+static void tap_case_end(reporter* r, outputInfo* out, const caseReport* c) {
+    (void)out;
+    fprintf(r->output, "%sok %zu - %s\n", c->res->result ? "not " : "", ++r->index, c->name);
+    if(c->res->result && c->failure_count) {
+        fputs("  ---\n  failures:\n", r->output);
+        for(size_t i = 0; i < c->failure_count; i++) {
+            const caseFailure* f = c->failures + i;
+            fputs("    - file: ", r->output);
+            report_write_json_str(r->output, f->file);
+            fprintf(r->output, "\n      line: %u\n      message: ", f->line);
+            report_write_json_str(r->output, f->msg);
+            fputc('\n', r->output);
+        }
+        fputs("  ...\n", r->output);
+    }
+    fflush(r->output);
+}
+
+static void tap_case_skip(reporter* r, outputInfo* out, const caseReport* c) {
+    (void)out;
+    fprintf(r->output, "ok %zu - %s # SKIP\n", ++r->index, c->name);
+}
+
+static void tap_summary(reporter* r, outputInfo* out, const runSummary* s) {
+    (void)out;
+    fprintf(r->output, "# passed %d failed %d skipped %d\n", s->passed, s->failed, s->skipped);
+    fflush(r->output);
+}
+
+static const reporterOps tap_ops = {
+    .suite_start = tap_suite_start,
+    .case_end    = tap_case_end,
+    .case_skip   = tap_case_skip,
+    .summary     = tap_summary
+};
+
+int reporter_init(reporter* r, const char* name, const char* path) {
+    memset(r, 0, sizeof(*r));
+    if(strcmp(name, "jsonl") == 0) {
+        r->ops = &jsonl_ops;
+    } else if(strcmp(name, "junit") == 0) {
+        r->ops = &junit_ops;
+    } else if(strcmp(name, "tap") == 0) {
+        r->ops = &tap_ops;
+    } else {
+        return 1;
+    }
+    r->output = stdout;
+    if(path != NULL) {
+        r->output = fopen(path, "w");
+        if(r->output == NULL) {
+            return 2;
+        }
+        r->close_output = 1;
+    }
+    return 0;
+}
+
+void reporter_close(reporter* r) {
+    if(r->ops != NULL && r->ops->close != NULL) {
+        r->ops->close(r);
+    }
+    if(r->close_output && r->output != NULL) {
+        fclose(r->output);
+    }
+    r->output = NULL;
+}
@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "shard.h"
+
+typedef struct {
+    uint64_t cost;
+    size_t   id;
+} shardItem;
+
+typedef struct {
+    uint64_t load;
+    size_t   id;
+} shardLoad;
+
+static int item_cmp(const void* a, const void* b) {
+    const shardItem* x = a;
+    const shardItem* y = b;
+    if(x->cost != y->cost) {
+        return x->cost < y->cost ? 1 : -1;
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static int load_less(const shardLoad* x, const shardLoad* y) {
+    return x->load < y->load || (x->load == y->load && x->id < y->id);
+}
+
+// Moves the root of the min heap down after it's load went up.
+static void heap_sift_down(shardLoad* heap, size_t count) {
+    size_t i = 0;
+    for(;;) {
+        size_t min   = i;
+        size_t left  = 2 * i + 1;
+        size_t right = left + 1;
+        if(left < count && load_less(heap + left, heap + min)) {
+            min = left;
+        }
+        if(right < count && load_less(heap + right, heap + min)) {
+            min = right;
+        }
+        if(min == i) {
+            return;
+        }
+        shardLoad tmp = heap[i];
+        heap[i]       = heap[min];
+        heap[min]     = tmp;
+        i = min;
+    }
+}
+
+int shard_partition(const uint64_t* cost, size_t count, size_t shards, size_t* shard_of) {
+    shardItem* items = malloc(sizeof(shardItem) * (count + 1));
+    shardLoad* heap  = malloc(sizeof(shardLoad) * shards);
+    if(items == NULL || heap == NULL) {
+        free(items);
+        free(heap);
+        return 1;
+    }
+    for(size_t i = 0; i < count; i++) {
+        items[i].cost = cost[i];
+        items[i].id   = i;
+    }
+    qsort(items, count, sizeof(shardItem), item_cmp);
+
+    // Every shard starts empty, so in id order it is already a heap.
+    for(size_t i = 0; i < shards; i++) {
+        heap[i].load = 0;
+        heap[i].id   = i;
+    }
+    for(size_t i = 0; i < count; i++) {
+        shard_of[items[i].id] = heap[0].id;
+        heap[0].load += items[i].cost;
+        heap_sift_down(heap, shards);
+    }
+    free(items);
+    free(heap);
+    return 0;
+}
@@ -1,5 +1,15 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "sys-info.h"
 
+#if CURRENT_ARCH == X86_64 && defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
 unsigned get_arch() {
     return CURRENT_ARCH;
 }
@@ -17,13 +27,404 @@ size_t get_memory_page_size() {
     return info.dwPageSize;
 }
 
+size_t get_cpu_count() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+int set_thread_cpu(size_t index) {
+    size_t cpu = index % get_cpu_count();
+    if(cpu >= sizeof(DWORD_PTR) * 8 || SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) == 0) {
+        return -1;
+    }
+    return (int)cpu;
+}
+
+int pin_thread(int cpu, threadAffinity* saved) {
+    if(cpu < 0 || (size_t)cpu >= sizeof(DWORD_PTR) * 8) {
+        return 1;
+    }
+    DWORD_PTR old = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu);
+    saved->mask[0] = old;
+    return old == 0;
+}
+
+void unpin_thread(const threadAffinity* saved) {
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)saved->mask[0]);
+}
+
+int raise_thread_priority(int* saved) {
+    int old = GetThreadPriority(GetCurrentThread());
+    if(old == THREAD_PRIORITY_ERROR_RETURN || old >= THREAD_PRIORITY_HIGHEST) {
+        return 0;
+    }
+    if(!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST)) {
+        return 0;
+    }
+    *saved = old;
+    return THREAD_PRIORITY_HIGHEST - old;
+}
+
+void restore_thread_priority(int saved) {
+    SetThreadPriority(GetCurrentThread(), saved);
+}
+
+// Caches are listed once for every core sharing them, the size is the
+// same each time.
+static void machine_probe(machineInfo* m) {
+    DWORD len = 0;
+    GetLogicalProcessorInformation(NULL, &len);
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION* info = malloc(len);
+    if(info == NULL || !GetLogicalProcessorInformation(info, &len)) {
+        free(info);
+        return;
+    }
+    for(size_t i = 0; i < len / sizeof(*info); i++) {
+        const CACHE_DESCRIPTOR* c = &(info[i].Cache);
+        switch(info[i].Relationship) {
+            case RelationProcessorCore:
+                m->cores++;
+                break;
+            case RelationNumaNode:
+                m->numa_nodes++;
+                break;
+            case RelationCache:
+                if(c->Level == 1 && c->Type != CacheInstruction) {
+                    m->l1d_size  = c->Size;
+                    m->line_size = c->LineSize;
+                } else if(c->Level == 2) {
+                    m->l2_size = c->Size;
+                } else if(c->Level == 3) {
+                    m->l3_size = c->Size;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    free(info);
+}
+
 #elif CURRENT_OS == OS_UNIX_LIKE || CURRENT_OS == OS_LINUX
+#include <errno.h>
 #include <unistd.h>
+#include <sys/resource.h>
+#if CURRENT_OS == OS_LINUX
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
 
 size_t get_memory_page_size() {
     return sysconf(_SC_PAGESIZE);
 }
 
+size_t get_cpu_count() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+}
+
+// Linux keeps a nice value for every thread, elsewhere it is the process.
+#if CURRENT_OS == OS_LINUX
+    #define THREAD_SELF ((id_t)syscall(SYS_gettid))
+#else
+    #define THREAD_SELF 0
+#endif
+
+int raise_thread_priority(int* saved) {
+    id_t self = THREAD_SELF;
+    errno     = 0;
+    int  old  = getpriority(PRIO_PROCESS, self);
+    if(old == -1 && errno != 0) {
+        return 0;
+    }
+    // Without the rights to go all the way it may still be let part way.
+    for(int nice = -20; nice < old; nice++) {
+        if(setpriority(PRIO_PROCESS, self, nice) == 0) {
+            *saved = old;
+            return old - nice;
+        }
+    }
+    return 0;
+}
+
+void restore_thread_priority(int saved) {
+    setpriority(PRIO_PROCESS, THREAD_SELF, saved);
+}
+
+#if CURRENT_OS == OS_LINUX
+// Counts through the CPUs the process may run on rather than all of them,
+// so a run limited with taskset or a cgroup still gets one each.
+int set_thread_cpu(size_t index) {
+    cpu_set_t allowed;
+    cpu_set_t want;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return -1;
+    }
+    size_t nth = index % (size_t)CPU_COUNT(&allowed);
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        if(nth-- == 0) {
+            CPU_ZERO(&want);
+            CPU_SET(cpu, &want);
+            return sched_setaffinity(0, sizeof(want), &want) == 0 ? cpu : -1;
+        }
+    }
+    return -1;
+}
+
+int pin_thread(int cpu, threadAffinity* saved) {
+    cpu_set_t old;
+    cpu_set_t want;
+    if(cpu < 0 || cpu >= CPU_SETSIZE || sched_getaffinity(0, sizeof(old), &old) != 0) {
+        return 1;
+    }
+    CPU_ZERO(&want);
+    CPU_SET(cpu, &want);
+    if(sched_setaffinity(0, sizeof(want), &want) != 0) {
+        return 1;
+    }
+    memset(saved, 0, sizeof(*saved));
+    memcpy(saved->mask, &old, sizeof(old) < sizeof(saved->mask) ? sizeof(old) : sizeof(saved->mask));
+    return 0;
+}
+
+void unpin_thread(const threadAffinity* saved) {
+    cpu_set_t old;
+    CPU_ZERO(&old);
+    memcpy(&old, saved->mask, sizeof(old) < sizeof(saved->mask) ? sizeof(old) : sizeof(saved->mask));
+    sched_setaffinity(0, sizeof(old), &old);
+}
+
+// Reads the first line of a sysfs or procfs file without the newline.
+static int sys_read(const char* path, char* buf, size_t len) {
+    FILE* file = fopen(path, "r");
+    if(file == NULL) {
+        return 1;
+    }
+    char* line = fgets(buf, (int)len, file);
+    fclose(file);
+    if(line == NULL) {
+        return 1;
+    }
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+static long sys_read_long(const char* path, long fallback) {
+    char  buf[32];
+    char* end = NULL;
+    if(sys_read(path, buf, sizeof(buf))) {
+        return fallback;
+    }
+    long value = strtol(buf, &end, 10);
+    return end == buf ? fallback : value;
+}
+
+// Cache sizes are written like 48K.
+static size_t sys_read_size(const char* path) {
+    char  buf[32];
+    char* end = NULL;
+    if(sys_read(path, buf, sizeof(buf))) {
+        return 0;
+    }
+    size_t size = strtoull(buf, &end, 10);
+    switch(*end) {
+        case 'K': return size << 10;
+        case 'M': return size << 20;
+        case 'G': return size << 30;
+        default:  return size;
+    }
+}
+
+// Counts the entries of a list like 0-3,8-11.
+static size_t sys_list_count(const char* list) {
+    size_t count = 0;
+    for(;;) {
+        char*         end = NULL;
+        unsigned long lo  = strtoul(list, &end, 10);
+        unsigned long hi  = lo;
+        if(end == list) {
+            return count;
+        }
+        if(*end == '-') {
+            list = end + 1;
+            hi   = strtoul(list, &end, 10);
+        }
+        count += hi >= lo ? hi - lo + 1 : 0;
+        if(*end != ',') {
+            return count;
+        }
+        list = end + 1;
+    }
+}
+
+static void machine_probe_caches(machineInfo* m) {
+    char path[96];
+    char type[32];
+    for(int i = 0; i < 16; i++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        if(sys_read(path, type, sizeof(type))) {
+            return;
+        }
+        if(strcmp(type, "Instruction") == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+        long level = sys_read_long(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        size_t size = sys_read_size(path);
+        if(level == 1) {
+            m->l1d_size = size;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/coherency_line_size", i);
+            m->line_size = (size_t)sys_read_long(path, 0);
+        } else if(level == 2) {
+            m->l2_size = size;
+        } else if(level == 3) {
+            m->l3_size = size;
+        }
+    }
+}
+
+// Hyperthreads share a core id within their package, so the cores are
+// the distinct pairs of the two. Offline CPUs have no topology to read.
+static size_t machine_count_cores(size_t threads) {
+    long   conf  = sysconf(_SC_NPROCESSORS_CONF);
+    size_t count = conf > 0 ? (size_t)conf : threads;
+    size_t cores = 0;
+    long*  ids   = malloc(sizeof(long) * 2 * count);
+    if(ids == NULL) {
+        return 0;
+    }
+    for(size_t cpu = 0; cpu < count; cpu++) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/topology/core_id", cpu);
+        long core = sys_read_long(path, -1);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/topology/physical_package_id", cpu);
+        long package = sys_read_long(path, -1);
+        if(core < 0) {
+            continue;
+        }
+        size_t i = 0;
+        while(i < cores && (ids[i * 2] != package || ids[i * 2 + 1] != core)) {
+            i++;
+        }
+        if(i == cores) {
+            ids[cores * 2]     = package;
+            ids[cores * 2 + 1] = core;
+            cores++;
+        }
+    }
+    free(ids);
+    return cores;
+}
+
+static void machine_probe_model(machineInfo* m) {
+    FILE* file = fopen("/proc/cpuinfo", "r");
+    char  line[256];
+    if(file == NULL) {
+        return;
+    }
+    while(fgets(line, sizeof(line), file) != NULL) {
+        char* value = strchr(line, ':');
+        if(strncmp(line, "model name", 10) == 0 && value != NULL) {
+            value += strspn(value + 1, " \t") + 1;
+            value[strcspn(value, "\n")] = '\0';
+            snprintf(m->cpu_model, sizeof(m->cpu_model), "%s", value);
+            break;
+        }
+    }
+    fclose(file);
+}
+
+static void machine_probe(machineInfo* m) {
+    char buf[64];
+    machine_probe_caches(m);
+    machine_probe_model(m);
+    m->cores = machine_count_cores(m->threads);
+    if(sys_read("/sys/devices/system/node/online", buf, sizeof(buf)) == 0) {
+        m->numa_nodes = sys_list_count(buf);
+    }
+    long khz = sys_read_long("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", 0);
+    m->max_mhz = khz > 0 ? (size_t)khz / 1000 : 0;
+    sys_read("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", m->governor, sizeof(m->governor));
+    // intel_pstate has a switch of it's own, acpi-cpufreq and amd-pstate
+    // use the generic one.
+    long no_turbo = sys_read_long("/sys/devices/system/cpu/intel_pstate/no_turbo", -1);
+    long boost    = sys_read_long("/sys/devices/system/cpu/cpufreq/boost", -1);
+    if(no_turbo >= 0) {
+        m->turbo = no_turbo == 0;
+    } else if(boost >= 0) {
+        m->turbo = boost != 0;
+    }
+    if(sys_read("/proc/loadavg", buf, sizeof(buf)) == 0) {
+        m->load_avg = strtod(buf, NULL);
+    }
+}
+#else
+int set_thread_cpu(size_t index) {
+    (void)index;
+    return -1;
+}
+
+int pin_thread(int cpu, threadAffinity* saved) {
+    (void)cpu;
+    (void)saved;
+    return 1;
+}
+
+void unpin_thread(const threadAffinity* saved) {
+    (void)saved;
+}
+
+static void machine_probe(machineInfo* m) {
+    (void)m;
+}
+#endif
+
 #else
     #error "Not ported to this OS"
-#endif
\ No newline at end of file
+#endif
+
+#if CURRENT_ARCH == X86_64 && defined(__GNUC__)
+// The brand string is padded with spaces at the front on some CPUs.
+static void machine_cpuid_model(machineInfo* m) {
+    unsigned regs[12];
+    char     brand[sizeof(regs) + 1];
+    if(__get_cpuid_max(0x80000000, NULL) < 0x80000004) {
+        return;
+    }
+    for(unsigned i = 0; i < 3; i++) {
+        __get_cpuid(0x80000002 + i, regs + i * 4, regs + i * 4 + 1, regs + i * 4 + 2, regs + i * 4 + 3);
+    }
+    memcpy(brand, regs, sizeof(regs));
+    brand[sizeof(regs)] = '\0';
+    snprintf(m->cpu_model, sizeof(m->cpu_model), "%s", brand + strspn(brand, " "));
+}
+#else
+static void machine_cpuid_model(machineInfo* m) {
+    (void)m;
+}
+#endif
+
+const machineInfo* get_machine_info() {
+    static machineInfo info;
+    static int         probed = 0;
+    if(probed) {
+        return &info;
+    }
+    memset(&info, 0, sizeof(info));
+    info.threads  = get_cpu_count();
+    info.turbo    = -1;
+    info.load_avg = -1;
+    machine_probe(&info);
+    if(info.cpu_model[0] == '\0') {
+        machine_cpuid_model(&info);
+    }
+    info.cores      = info.cores ? info.cores : info.threads;
+    info.numa_nodes = info.numa_nodes ? info.numa_nodes : 1;
+    probed = 1;
+    return &info;
+}
@@ -0,0 +1,205 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ktest.h"
+#include "reporter.h"
+#include "sys-info.h"
+#include "timer.h"
+
+// Spins this many times between giving up the CPU while waiting to be
+// released, in case there are more threads than CPUs to spin on.
+#define THREAD_SPINS 1024
+
+typedef struct thread_run_s threadRun;
+
+typedef struct {
+    pthread_t   thread;
+    threadRun*  run;
+    size_t      index;
+    kTestStatus stat;
+    char*       buf;
+    size_t      buf_sz;
+    int         cpu;
+    uint64_t    start_ns;
+    uint64_t    end_ns;
+} threadSlot;
+
+// Every thread counts itself in once it is pinned and then waits for go.
+// A pthread barrier would wait forever for a thread that failed to start,
+// this way the ones that did are still released and ran.
+struct thread_run_s {
+    threadFn      fn;
+    void*         fix;
+    void*         ctx;
+    FILE*         output;
+    threadSlot*   slots;
+    atomic_size_t ready;
+    atomic_int    go;
+};
+
+static void thread_pause() {
+    #if defined(__GNUC__) && CURRENT_ARCH == X86_64
+    __builtin_ia32_pause();
+    #elif defined(__GNUC__) && CURRENT_ARCH == ARM_64
+    __asm__ __volatile__("yield");
+    #endif
+}
+
+#if CURRENT_OS == OS_LINUX || CURRENT_OS == OS_UNIX_LIKE
+static int thread_output_open(threadSlot* slot) {
+    slot->stat.output = open_memstream(&(slot->buf), &(slot->buf_sz));
+    return slot->stat.output == NULL;
+}
+
+static void thread_output_close(threadSlot* slot, FILE* dst) {
+    fclose(slot->stat.output);
+    fwrite(slot->buf, 1, slot->buf_sz, dst);
+    free(slot->buf);
+}
+#else
+static int thread_output_open(threadSlot* slot) {
+    slot->stat.output = tmpfile();
+    return slot->stat.output == NULL;
+}
+
+static void thread_output_close(threadSlot* slot, FILE* dst) {
+    char   chunk[4096];
+    size_t amt;
+    fflush(slot->stat.output);
+    rewind(slot->stat.output);
+    while((amt = fread(chunk, 1, sizeof(chunk), slot->stat.output)) > 0) {
+        fwrite(chunk, 1, amt, dst);
+    }
+    fclose(slot->stat.output);
+}
+#endif
+
+static void* thread_main(void* arg) {
+    threadSlot* slot = arg;
+    threadRun*  run  = slot->run;
+    ktest_report_adopt(run->ctx);
+    slot->cpu = set_thread_cpu(slot->index);
+    // Sharing the case's output may interleave but loses nothing.
+    if(run->output != NULL && thread_output_open(slot)) {
+        slot->stat.output = run->output;
+    }
+
+    atomic_fetch_add(&(run->ready), 1);
+    for(unsigned spins = 1; !atomic_load_explicit(&(run->go), memory_order_acquire); spins++) {
+        if(spins % THREAD_SPINS == 0) {
+            sched_yield();
+        } else {
+            thread_pause();
+        }
+    }
+    slot->start_ns = timer_now_ns();
+    run->fn(&(slot->stat), run->fix, slot->index);
+    slot->end_ns = timer_now_ns();
+    ktest_report_adopt(NULL);
+    return NULL;
+}
+
+// Each thread writes into a buffer of it's own, they are printed one
+// after another once all of them are done so lines never interleave.
+static void thread_print_output(FILE* out, threadSlot* slot) {
+    if(slot->stat.output == out) {
+        return;
+    }
+    fflush(slot->stat.output);
+    if(ftell(slot->stat.output) > 0) {
+        fprintf(out, "      Thread : %zu\n", slot->index);
+    }
+    thread_output_close(slot, out);
+}
+
+static void thread_print_times(FILE* out, const threadSlot* slots, size_t count) {
+    char     buffer[14] = { 0 };
+    uint64_t fastest    = UINT64_MAX;
+    uint64_t slowest    = 0;
+    uint64_t first      = UINT64_MAX;
+    uint64_t last       = 0;
+    size_t   pinned     = 0;
+    for(size_t i = 0; i < count; i++) {
+        uint64_t ns = slots[i].end_ns - slots[i].start_ns;
+        fastest = ns < fastest ? ns : fastest;
+        slowest = ns > slowest ? ns : slowest;
+        first   = slots[i].start_ns < first ? slots[i].start_ns : first;
+        last    = slots[i].start_ns > last  ? slots[i].start_ns : last;
+        pinned += slots[i].cpu >= 0;
+    }
+    fprintf(out, "     Threads : %zu, %zu pinned\n", count, pinned);
+    for(size_t i = 0; i < count; i++) {
+        timer_format_ns_u64(slots[i].end_ns - slots[i].start_ns, buffer);
+        if(slots[i].cpu >= 0) {
+            fprintf(out, "%12zu : %s on cpu %d\n", i, buffer, slots[i].cpu);
+        } else {
+            fprintf(out, "%12zu : %s\n", i, buffer);
+        }
+    }
+    timer_format_ns_u64(last - first, buffer);
+    fprintf(out, "  Start Skew : %s\n", buffer);
+    timer_format_ns_u64(slowest - fastest, buffer);
+    fprintf(
+        out,
+        "      Spread : %s, %.2f%% of the slowest\n\n",
+        buffer,
+        slowest ? (double)(slowest - fastest) * 100 / (double)slowest : 0
+    );
+}
+
+void ktest_run_threaded(kTestStatus* status, void* fix, size_t threads, threadFn fn) {
+    size_t    count   = threads ? threads : get_cpu_count();
+    size_t    started = 0;
+    threadRun run     = {
+        .fn     = fn,
+        .fix    = fix,
+        .ctx    = ktest_report_context(),
+        .output = status->output
+    };
+    atomic_init(&(run.ready), 0);
+    atomic_init(&(run.go), 0);
+    run.slots = calloc(count, sizeof(threadSlot));
+    if(run.slots == NULL) {
+        status->result = 1;
+        ktest_report_failure(NULL, 0, "allocating %zu threads failed", count);
+        return;
+    }
+
+    for(; started < count; started++) {
+        threadSlot* slot = run.slots + started;
+        slot->run   = &run;
+        slot->index = started;
+        if(pthread_create(&(slot->thread), NULL, thread_main, slot) != 0) {
+            break;
+        }
+    }
+    while(atomic_load(&(run.ready)) < started) {
+        sched_yield();
+    }
+    atomic_store_explicit(&(run.go), 1, memory_order_release);
+
+    for(size_t i = 0; i < started; i++) {
+        threadSlot* slot = run.slots + i;
+        pthread_join(slot->thread, NULL);
+        status->asserts += slot->stat.asserts;
+        status->expects += slot->stat.expects;
+        status->result  |= slot->stat.result;
+        if(status->output != NULL) {
+            thread_print_output(status->output, slot);
+        }
+    }
+    if(started < count) {
+        status->result = 1;
+        ktest_report_failure(NULL, 0, "only %zu of %zu threads started", started, count);
+        if(status->output != NULL) {
+            fprintf(status->output, "     Threads : only %zu of %zu started\n\n", started, count);
+        }
+    } else if(status->output != NULL) {
+        thread_print_times(status->output, run.slots, count);
+    }
+    free(run.slots);
+}
@@ -0,0 +1,42 @@
+#include "timer.h"
+
+// Until calibrated treat the counter as nanoseconds with no overhead
+static double   ns_per_cycle   = 1;
+static uint64_t cycle_overhead = 0;
+
+void timer_calibrate() {
+    timerData t = { 0 };
+    // Spin for 10ms, reading the clock on the outside of the counter
+    // at both ends so the error is at most a couple of clock reads.
+    timer_start(&t);
+    uint64_t c0 = timer_cycles_begin();
+    do {
+        timer_stop(&t);
+    } while(timer_get_ns(&t) < 10000000);
+    uint64_t c1 = timer_cycles_end();
+    timer_stop(&t);
+    uint64_t ns = timer_get_ns(&t);
+    if(c1 > c0) {
+        ns_per_cycle = (double)ns / (c1 - c0);
+    }
+
+    // The cheapest empty measurement is the part of every reading that
+    // is only the cost of the timer itself.
+    uint64_t best = UINT64_MAX;
+    for(int i = 0; i < 1000; i++) {
+        uint64_t a = timer_cycles_begin();
+        uint64_t b = timer_cycles_end();
+        if(b - a < best) {
+            best = b - a;
+        }
+    }
+    cycle_overhead = best == UINT64_MAX ? 0 : best;
+}
+
+double timer_ns_per_cycle() {
+    return ns_per_cycle;
+}
+
+uint64_t timer_cycle_overhead() {
+    return cycle_overhead;
+}
@@ -0,0 +1,47 @@
+// Only has to compile. The checks must warn no more than the bare compares
+// would, this is built with -Wall -Wextra -Werror by make check.
+#include <stddef.h>
+
+#include "ktest.h"
+
+enum cmpColor { CMP_RED, CMP_GREEN };
+
+typedef struct {
+    unsigned small : 4;
+    int      wide  : 20;
+} cmpBits;
+
+KTEST_CASE(cmp_unsigned_literal) {
+    size_t   size  = 3;
+    unsigned count = 3;
+    (void)fix;
+    K_EXPECT_EQ(size, 3);
+    K_EXPECT_EQ(3, size);
+    K_EXPECT_LT(count, 4);
+    K_EXPECT_GE(size, sizeof(char));
+    K_ASSERT_NE(count, 0);
+}
+
+KTEST_CASE(cmp_pointer_null) {
+    int         value = 0;
+    int*        ptr   = &value;
+    const void* vptr  = ptr;
+    (void)fix;
+    K_EXPECT_NE(ptr, 0);
+    K_EXPECT_NE(ptr, NULL);
+    K_EXPECT_NE(NULL, ptr);
+    K_ASSERT_NE(vptr, NULL);
+    K_ASSERT_EQ(ptr, &value);
+}
+
+KTEST_CASE(cmp_other_operands) {
+    cmpBits       bits  = { 5, -2 };
+    enum cmpColor color = CMP_GREEN;
+    double        ratio = 0.5;
+    (void)fix;
+    K_EXPECT_EQ(bits.small, 5u);
+    K_EXPECT_EQ(bits.wide, -2);
+    K_EXPECT_EQ(color, CMP_GREEN);
+    K_EXPECT_LT(ratio, 1.0);
+    K_EXPECT_EQ_TRUE(ratio < 1.0);
+}